@@ -23,6 +23,11 @@ static const char *ini_keys[] = {
     "ui_show_water_structure_range",
     "ui_show_construction_size",
     "ui_highlight_legions",
+    "screen_threaded_city_drawing",
+    "screen_lazy_image_decoding",
+    "game_snapshot_count",
+    "game_monthly_snapshots",
+    "game_snapshot_memory_limit",
 };
 
 static const char *ini_string_keys[] = {
@@ -34,7 +39,9 @@ static char string_values[CONFIG_STRING_MAX_ENTRIES][CONFIG_STRING_VALUE_MAX];
 
 static int default_values[CONFIG_MAX_ENTRIES] = {
     [CONFIG_SCREEN_DISPLAY_SCALE] = 100,
-    [CONFIG_SCREEN_CURSOR_SCALE] = 100
+    [CONFIG_SCREEN_CURSOR_SCALE] = 100,
+    [CONFIG_GAME_SNAPSHOT_COUNT] = 120,
+    [CONFIG_GAME_SNAPSHOT_MEMORY_LIMIT] = 64
 };
 static const char default_string_values[CONFIG_STRING_MAX_ENTRIES][CONFIG_STRING_VALUE_MAX];
 
@@ -17,6 +17,11 @@ typedef enum {
     CONFIG_UI_SHOW_WATER_STRUCTURE_RANGE,
     CONFIG_UI_SHOW_CONSTRUCTION_SIZE,
     CONFIG_UI_HIGHLIGHT_LEGIONS,
+    CONFIG_SCREEN_THREADED_CITY_DRAWING,
+    CONFIG_SCREEN_LAZY_IMAGE_DECODING,
+    CONFIG_GAME_SNAPSHOT_COUNT,
+    CONFIG_GAME_MONTHLY_SNAPSHOTS,
+    CONFIG_GAME_SNAPSHOT_MEMORY_LIMIT,
     CONFIG_MAX_ENTRIES
 } config_key;
 
@@ -0,0 +1,137 @@
+#include "core/delta.h"
+
+#include <stdint.h>
+#include <string.h>
+
+// Shorter runs of unchanged bytes are cheaper to store inside a literal
+#define MIN_UNCHANGED_RUN 4
+#define MAX_VARINT_LENGTH 5
+
+static int unchanged_run_length(const uint8_t *old_data, const uint8_t *new_data, int position, int length)
+{
+    int start = position;
+    while (position + 8 <= length) {
+        uint64_t old_word;
+        uint64_t new_word;
+        memcpy(&old_word, &old_data[position], 8);
+        memcpy(&new_word, &new_data[position], 8);
+        if (old_word != new_word) {
+            break;
+        }
+        position += 8;
+    }
+    while (position < length && old_data[position] == new_data[position]) {
+        position++;
+    }
+    return position - start;
+}
+
+static int changed_run_length(const uint8_t *old_data, const uint8_t *new_data, int position, int length)
+{
+    int start = position;
+    while (position < length) {
+        if (old_data[position] != new_data[position]) {
+            position++;
+            continue;
+        }
+        int unchanged = 0;
+        while (unchanged < MIN_UNCHANGED_RUN && position + unchanged < length &&
+            old_data[position + unchanged] == new_data[position + unchanged]) {
+            unchanged++;
+        }
+        if (unchanged >= MIN_UNCHANGED_RUN || position + unchanged >= length) {
+            break;
+        }
+        position += unchanged;
+    }
+    return position - start;
+}
+
+static uint8_t *write_varint(uint8_t *output, unsigned int value)
+{
+    while (value >= 0x80) {
+        *output++ = (uint8_t) (value | 0x80);
+        value >>= 7;
+    }
+    *output++ = (uint8_t) value;
+    return output;
+}
+
+static int read_varint(const uint8_t *input, int *position, int length, unsigned int *value)
+{
+    *value = 0;
+    for (int shift = 0; shift < 7 * MAX_VARINT_LENGTH; shift += 7) {
+        if (*position >= length) {
+            return 0;
+        }
+        uint8_t byte = input[(*position)++];
+        *value |= (unsigned int) (byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int delta_max_encoded_length(int length)
+{
+    // Every changed run is followed by at least MIN_UNCHANGED_RUN unchanged bytes
+    return length + (length / (MIN_UNCHANGED_RUN + 1) + 1) * 2 * MAX_VARINT_LENGTH;
+}
+
+int delta_encode(const void *old_data, const void *new_data, int length, void *output_buffer, int *output_length)
+{
+    const uint8_t *old_bytes = (const uint8_t *) old_data;
+    const uint8_t *new_bytes = (const uint8_t *) new_data;
+    uint8_t *output = (uint8_t *) output_buffer;
+    uint8_t *output_end = output + *output_length;
+    int position = 0;
+    while (position < length) {
+        int unchanged = unchanged_run_length(old_bytes, new_bytes, position, length);
+        position += unchanged;
+        if (position >= length) {
+            break;
+        }
+        int changed = changed_run_length(old_bytes, new_bytes, position, length);
+        if (output_end - output < 2 * MAX_VARINT_LENGTH + changed) {
+            return 0;
+        }
+        output = write_varint(output, (unsigned int) unchanged);
+        output = write_varint(output, (unsigned int) changed);
+        for (int i = 0; i < changed; i++) {
+            output[i] = old_bytes[position + i] ^ new_bytes[position + i];
+        }
+        output += changed;
+        position += changed;
+    }
+    *output_length = (int) (output - (uint8_t *) output_buffer);
+    return 1;
+}
+
+int delta_apply(void *data, int length, const void *delta, int delta_length)
+{
+    uint8_t *bytes = (uint8_t *) data;
+    const uint8_t *input = (const uint8_t *) delta;
+    int input_position = 0;
+    unsigned int position = 0;
+    while (input_position < delta_length) {
+        unsigned int unchanged;
+        unsigned int changed;
+        if (!read_varint(input, &input_position, delta_length, &unchanged) ||
+            !read_varint(input, &input_position, delta_length, &changed)) {
+            return 0;
+        }
+        if (unchanged > (unsigned int) length - position ||
+            changed > (unsigned int) length - position - unchanged ||
+            changed > (unsigned int) (delta_length - input_position)) {
+            return 0;
+        }
+        position += unchanged;
+        for (unsigned int i = 0; i < changed; i++) {
+            bytes[position + i] ^= input[input_position + i];
+        }
+        position += changed;
+        input_position += changed;
+    }
+    return 1;
+}
@@ -0,0 +1,40 @@
+#ifndef CORE_DELTA_H
+#define CORE_DELTA_H
+
+/**
+ * @file
+ * Delta encoding between two versions of a block of data.
+ *
+ * A delta holds the bytewise XOR of both versions, with runs of unchanged
+ * bytes left out. Applying a delta to either version yields the other one.
+ */
+
+/**
+ * Gets the output buffer size needed to encode a delta in the worst case
+ * @param length Length of the data
+ * @return Maximum length of the encoded delta
+ */
+int delta_max_encoded_length(int length);
+
+/**
+ * Encodes the differences between two versions of the data
+ * @param old_data Old version of the data
+ * @param new_data New version of the data
+ * @param length Length of both versions
+ * @param output_buffer Output buffer to write the delta to
+ * @param output_length IN: available length of the output buffer, OUT: written bytes
+ * @return boolean true on success, false if the output buffer is too small
+ */
+int delta_encode(const void *old_data, const void *new_data, int length, void *output_buffer, int *output_length);
+
+/**
+ * Applies a delta to the data in place
+ * @param data Data to change, either version the delta was encoded from
+ * @param length Length of the data
+ * @param delta Delta to apply
+ * @param delta_length Length of the delta
+ * @return boolean true on success, false if the delta is invalid
+ */
+int delta_apply(void *data, int length, const void *delta, int delta_length);
+
+#endif // CORE_DELTA_H
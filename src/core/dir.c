@@ -4,18 +4,78 @@
 #include "core/file.h"
 #include "core/string.h"
 #include "platform/file_manager.h"
+#include "platform/thread.h"
 
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #define BASE_MAX_FILES 100
+#define MAX_CACHED_LISTINGS 16
+#define MAX_EXTENSION_LENGTH 8
+#define NO_FILE -1
+
+typedef struct {
+    int in_use;
+    char dir[2 * FILE_NAME_MAX];
+    int type;
+    char extension[MAX_EXTENSION_LENGTH];
+    int64_t modified_time;
+    time_t listed_time;
+    unsigned int last_used;
+    char **files;
+    int num_files;
+    int max_files;
+    int *hash_table;
+    int hash_size;
+} cached_listing;
 
 static struct {
     dir_listing listing;
     int max_files;
-    char *cased_filename;
+    cached_listing cache[MAX_CACHED_LISTINGS];
+    cached_listing *filling;
+    unsigned int use_counter;
+    platform_mutex *cache_mutex;
 } data;
 
+// Files are also opened from worker threads during startup, so the cache is shared
+static platform_mutex *get_cache_mutex(void)
+{
+    platform_mutex *mutex = platform_atomic_get_ptr((void **) &data.cache_mutex);
+    if (!mutex) {
+        platform_mutex *new_mutex = platform_mutex_create();
+        if (!new_mutex) {
+            return 0;
+        }
+        if (platform_atomic_cas_ptr((void **) &data.cache_mutex, 0, new_mutex)) {
+            mutex = new_mutex;
+        } else {
+            // another thread created the mutex first
+            platform_mutex_destroy(new_mutex);
+            mutex = platform_atomic_get_ptr((void **) &data.cache_mutex);
+        }
+    }
+    return mutex;
+}
+
+static void lock_cache(void)
+{
+    platform_mutex *mutex = get_cache_mutex();
+    if (mutex) {
+        platform_mutex_lock(mutex);
+    }
+}
+
+static void unlock_cache(void)
+{
+    platform_mutex *mutex = get_cache_mutex();
+    if (mutex) {
+        platform_mutex_unlock(mutex);
+    }
+}
+
 static void allocate_listing_files(int min, int max)
 {
     for (int i = min; i < max; i++) {
@@ -53,51 +113,228 @@ static int compare_lower(const void *va, const void *vb)
     return platform_file_manager_compare_filename(*(const char **) va, *(const char **) vb);
 }
 
-static int add_to_listing(const char *filename)
+static unsigned int hash_lowercase(const char *filename)
 {
-    if (data.listing.num_files >= data.max_files) {
-        expand_dir_listing();
+    unsigned int hash = 2166136261u;
+    for (; *filename; filename++) {
+        uint8_t c = (uint8_t) *filename;
+        if (c >= 'A' && c <= 'Z') {
+            c += 'a' - 'A';
+        }
+        hash ^= c;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static int add_to_cache(const char *filename)
+{
+    cached_listing *listing = data.filling;
+    if (listing->num_files >= listing->max_files) {
+        int max_files = listing->max_files ? 2 * listing->max_files : BASE_MAX_FILES;
+        char **files = (char **) realloc(listing->files, max_files * sizeof(char *));
+        if (!files) {
+            return LIST_CONTINUE;
+        }
+        listing->files = files;
+        listing->max_files = max_files;
+    }
+    size_t length = strlen(filename) + 1;
+    char *file = (char *) malloc(length);
+    if (file) {
+        memcpy(file, filename, length);
+        listing->files[listing->num_files++] = file;
     }
-    strncpy(data.listing.files[data.listing.num_files], filename, FILE_NAME_MAX);
-    data.listing.files[data.listing.num_files][FILE_NAME_MAX - 1] = 0;
-    ++data.listing.num_files;
     return LIST_CONTINUE;
 }
 
-const dir_listing *dir_find_files_with_extension(const char *extension)
+static void clear_cached_listing(cached_listing *listing)
+{
+    for (int i = 0; i < listing->num_files; i++) {
+        free(listing->files[i]);
+    }
+    listing->num_files = 0;
+    listing->in_use = 0;
+}
+
+static void build_hash_table(cached_listing *listing)
+{
+    int hash_size = 2 * BASE_MAX_FILES;
+    while (hash_size < 2 * listing->num_files) {
+        hash_size *= 2;
+    }
+    if (hash_size != listing->hash_size) {
+        int *hash_table = (int *) realloc(listing->hash_table, hash_size * sizeof(int));
+        if (!hash_table) {
+            // Lookups fall back to a linear search
+            free(listing->hash_table);
+            listing->hash_table = 0;
+            listing->hash_size = 0;
+            return;
+        }
+        listing->hash_table = hash_table;
+        listing->hash_size = hash_size;
+    }
+    unsigned int mask = (unsigned int) hash_size - 1;
+    for (int i = 0; i < hash_size; i++) {
+        listing->hash_table[i] = NO_FILE;
+    }
+    for (int i = 0; i < listing->num_files; i++) {
+        unsigned int slot = hash_lowercase(listing->files[i]) & mask;
+        while (listing->hash_table[slot] != NO_FILE) {
+            slot = (slot + 1) & mask;
+        }
+        listing->hash_table[slot] = i;
+    }
+}
+
+static const char *find_cased_file(const cached_listing *listing, const char *filename)
+{
+    if (!listing->hash_table) {
+        for (int i = 0; i < listing->num_files; i++) {
+            if (platform_file_manager_compare_filename(listing->files[i], filename) == 0) {
+                return listing->files[i];
+            }
+        }
+        return 0;
+    }
+    unsigned int mask = (unsigned int) listing->hash_size - 1;
+    for (unsigned int slot = hash_lowercase(filename) & mask; listing->hash_table[slot] != NO_FILE;
+        slot = (slot + 1) & mask) {
+        const char *file = listing->files[listing->hash_table[slot]];
+        if (platform_file_manager_compare_filename(file, filename) == 0) {
+            return file;
+        }
+    }
+    return 0;
+}
+
+static int is_same_listing(const cached_listing *listing, const char *dir, int type, const char *extension)
+{
+    return listing->in_use && listing->type == type &&
+        strncmp(listing->extension, extension, MAX_EXTENSION_LENGTH - 1) == 0 &&
+        strncmp(listing->dir, dir, 2 * FILE_NAME_MAX - 1) == 0;
+}
+
+static int is_up_to_date(const cached_listing *listing, const char *dir)
+{
+    int64_t modified_time;
+    int64_t size;
+    if (!platform_file_manager_get_file_info(dir, &modified_time, &size)) {
+        return 0;
+    }
+    // Changes within the second the directory was listed would not change its modification time
+    return modified_time == listing->modified_time && (time_t) modified_time < listing->listed_time;
+}
+
+static const cached_listing *get_cached_listing(const char *dir, int type, const char *extension)
+{
+    if (!dir || !*dir) {
+        dir = ".";
+    }
+    if (!extension) {
+        extension = "";
+    }
+    cached_listing *listing = 0;
+    for (int i = 0; i < MAX_CACHED_LISTINGS; i++) {
+        if (is_same_listing(&data.cache[i], dir, type, extension)) {
+            listing = &data.cache[i];
+            break;
+        }
+    }
+    if (listing && is_up_to_date(listing, dir)) {
+        listing->last_used = ++data.use_counter;
+        return listing;
+    }
+    if (!listing) {
+        listing = &data.cache[0];
+        for (int i = 1; i < MAX_CACHED_LISTINGS && listing->in_use; i++) {
+            if (!data.cache[i].in_use || data.cache[i].last_used < listing->last_used) {
+                listing = &data.cache[i];
+            }
+        }
+    }
+    clear_cached_listing(listing);
+
+    int64_t size;
+    if (!platform_file_manager_get_file_info(dir, &listing->modified_time, &size)) {
+        listing->modified_time = -1;
+    }
+    listing->listed_time = time(0);
+    data.filling = listing;
+    if (platform_file_manager_list_directory_contents(dir, type, extension, add_to_cache) == LIST_ERROR) {
+        clear_cached_listing(listing);
+        return 0;
+    }
+    qsort(listing->files, listing->num_files, sizeof(char *), compare_lower);
+    build_hash_table(listing);
+
+    strncpy(listing->dir, dir, 2 * FILE_NAME_MAX - 1);
+    listing->dir[2 * FILE_NAME_MAX - 1] = 0;
+    strncpy(listing->extension, extension, MAX_EXTENSION_LENGTH - 1);
+    listing->extension[MAX_EXTENSION_LENGTH - 1] = 0;
+    listing->type = type;
+    listing->in_use = 1;
+    listing->last_used = ++data.use_counter;
+    return listing;
+}
+
+static const dir_listing *copy_listing(const char *dir, int type, const char *extension)
 {
     clear_dir_listing();
+    lock_cache();
+    const cached_listing *listing = get_cached_listing(dir, type, extension);
+    if (!listing) {
+        unlock_cache();
+        return &data.listing;
+    }
+    while (data.max_files < listing->num_files) {
+        expand_dir_listing();
+    }
+    for (int i = 0; i < listing->num_files; i++) {
+        strncpy(data.listing.files[i], listing->files[i], FILE_NAME_MAX);
+        data.listing.files[i][FILE_NAME_MAX - 1] = 0;
+    }
+    data.listing.num_files = listing->num_files;
+    unlock_cache();
+    return &data.listing;
+}
+
+const dir_listing *dir_find_files_with_extension(const char *extension)
+{
     if (strcmp(extension, "map") == 0) {
-        platform_file_manager_list_directory_contents(MAPS_DIR_PATH, TYPE_FILE, extension, add_to_listing);
+        return copy_listing(MAPS_DIR_PATH, TYPE_FILE, extension);
     } else if (strcmp(extension, "sav") == 0) {
-        platform_file_manager_list_directory_contents(SAVES_DIR_PATH, TYPE_FILE, extension, add_to_listing);
+        return copy_listing(SAVES_DIR_PATH, TYPE_FILE, extension);
     }
-
-    qsort(data.listing.files, data.listing.num_files, sizeof(char *), compare_lower);
+    clear_dir_listing();
     return &data.listing;
 }
 
 const dir_listing *dir_find_all_subdirectories(void)
 {
-    clear_dir_listing();
-    platform_file_manager_list_directory_contents(0, TYPE_DIR, 0, add_to_listing);
-    qsort(data.listing.files, data.listing.num_files, sizeof(char *), compare_lower);
-    return &data.listing;
+    return copy_listing(0, TYPE_DIR, 0);
 }
 
-static int compare_case(const char *filename)
+void dir_invalidate_cache(void)
 {
-    if (platform_file_manager_compare_filename(filename, data.cased_filename) == 0) {
-        strcpy(data.cased_filename, filename);
-        return LIST_MATCH;
+    lock_cache();
+    for (int i = 0; i < MAX_CACHED_LISTINGS; i++) {
+        clear_cached_listing(&data.cache[i]);
     }
-    return LIST_NO_MATCH;
+    unlock_cache();
 }
 
 static int correct_case(const char *dir, char *filename, int type)
 {
-    data.cased_filename = filename;
-    return platform_file_manager_list_directory_contents(dir, type, 0, compare_case) == LIST_MATCH;
+    lock_cache();
+    const cached_listing *listing = get_cached_listing(dir, type, 0);
+    const char *cased_filename = listing ? find_cased_file(listing, filename) : 0;
+    if (cased_filename) {
+        strcpy(filename, cased_filename);
+    }
+    unlock_cache();
+    return cased_filename != 0;
 }
 
 static void move_left(char *str)
@@ -123,7 +360,7 @@ void prepend_dir_to_path(const char *dir_to_prepend, const char *filepath, char
 
 const char *get_case_corrected_file(const char *dir, const char *filepath)
 {
-    static char corrected_filename[2 * FILE_NAME_MAX];
+    static THREAD_LOCAL char corrected_filename[2 * FILE_NAME_MAX];
     corrected_filename[2 * FILE_NAME_MAX - 1] = 0;
 
     size_t dir_len = 0;
@@ -27,6 +27,12 @@ const dir_listing *dir_find_files_with_extension(const char *extension);
  */
 const dir_listing *dir_find_all_subdirectories(void);
 
+/**
+ * Forgets all cached directory listings, to be called after writing or deleting files.
+ * Changes by other programs are noticed through the directory modification time.
+ */
+void dir_invalidate_cache(void);
+
 /**
  * Prepends given directory to path
  * @param dir_to_prepend Directory to prepend
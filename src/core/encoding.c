@@ -3,8 +3,12 @@
 #include "core/string.h"
 
 #include <stdlib.h>
+#include <string.h>
 
 #define HIGH_CHAR_COUNT 128
+#define LOOKUP_TABLE_BITS 9
+#define LOOKUP_TABLE_SIZE (1 << LOOKUP_TABLE_BITS)
+#define ASCII_RUN_SIZE 8
 
 typedef struct {
     uint8_t internal_value;
@@ -153,10 +157,9 @@ static const letter_code HIGH_TO_UTF8_DEFAULT[HIGH_CHAR_COUNT] = {
 static struct {
     encoding_type encoding;
     const letter_code *to_utf8_table;
-    from_utf8_lookup from_utf8_table[HIGH_CHAR_COUNT];
-    from_utf8_lookup from_utf8_decomposed_table[HIGH_CHAR_COUNT];
-    int utf8_table_size;
-    int decomposed_table_size;
+    // Open addressing hash tables, at most a quarter full so lookups rarely probe twice
+    from_utf8_lookup from_utf8_table[LOOKUP_TABLE_SIZE];
+    from_utf8_lookup from_utf8_decomposed_table[LOOKUP_TABLE_SIZE];
 } data;
 
 static uint32_t calculate_utf8_value(const uint8_t *bytes, int length)
@@ -177,46 +180,52 @@ static uint32_t calculate_utf8_value(const uint8_t *bytes, int length)
     return value;
 }
 
-static int compare_utf8_lookup(const void *a, const void *b)
+static unsigned int hash_utf8_value(uint32_t value)
 {
-    uint32_t va = ((const from_utf8_lookup *) a)->utf8;
-    uint32_t vb = ((const from_utf8_lookup *) b)->utf8;
-    return va == vb ? 0 : (va < vb ? -1 : 1);
+    return (uint32_t) (value * 2654435761u) >> (32 - LOOKUP_TABLE_BITS);
+}
+
+static void add_to_lookup_table(from_utf8_lookup *table, uint32_t utf8, const letter_code *code)
+{
+    unsigned int slot = hash_utf8_value(utf8);
+    while (table[slot].code) {
+        if (table[slot].utf8 == utf8) {
+            return;
+        }
+        slot = (slot + 1) & (LOOKUP_TABLE_SIZE - 1);
+    }
+    table[slot].utf8 = utf8;
+    table[slot].code = code;
 }
 
 static void build_reverse_lookup_table(void)
 {
+    memset(data.from_utf8_table, 0, sizeof(data.from_utf8_table));
     if (!data.to_utf8_table) {
-        data.utf8_table_size = 0;
         return;
     }
     for (int i = 0; i < HIGH_CHAR_COUNT; i++) {
         const letter_code *code = &data.to_utf8_table[i];
-        data.from_utf8_table[i].code = code;
-        data.from_utf8_table[i].utf8 = calculate_utf8_value(code->utf8_value, code->bytes);
+        // Single-byte values are ASCII, which never needs a lookup
+        if (code->bytes > 1) {
+            add_to_lookup_table(data.from_utf8_table, calculate_utf8_value(code->utf8_value, code->bytes), code);
+        }
     }
-    data.utf8_table_size = HIGH_CHAR_COUNT;
-    qsort(data.from_utf8_table, data.utf8_table_size, sizeof(from_utf8_lookup), compare_utf8_lookup);
 }
 
 static void build_decomposed_lookup_table(void)
 {
+    memset(data.from_utf8_decomposed_table, 0, sizeof(data.from_utf8_decomposed_table));
     if (!data.to_utf8_table) {
-        data.decomposed_table_size = 0;
         return;
     }
-    int index = 0;
     for (int i = 0; i < HIGH_CHAR_COUNT; i++) {
         const letter_code *code = &data.to_utf8_table[i];
         if (code->bytes_decomposed > 0) {
-            data.from_utf8_decomposed_table[index].code = code;
-            data.from_utf8_decomposed_table[index].utf8 =
-                calculate_utf8_value(code->utf8_decomposed, code->bytes_decomposed);
-            index++;
+            add_to_lookup_table(data.from_utf8_decomposed_table,
+                calculate_utf8_value(code->utf8_decomposed, code->bytes_decomposed), code);
         }
     }
-    data.decomposed_table_size = index;
-    qsort(data.from_utf8_decomposed_table, data.decomposed_table_size, sizeof(from_utf8_lookup), compare_utf8_lookup);
 }
 
 static const letter_code *get_letter_code_for_internal(uint8_t c)
@@ -255,16 +264,22 @@ static int is_combining_char(uint8_t b1, uint8_t b2)
     return 0;
 }
 
-static const letter_code *search_utf8_table(const from_utf8_lookup *key, const from_utf8_lookup *table, int size)
+static const letter_code *search_utf8_table(uint32_t utf8, const from_utf8_lookup *table)
 {
-    const from_utf8_lookup *result = bsearch(key, table, size, sizeof(from_utf8_lookup), compare_utf8_lookup);
-    return result ? result->code : NULL;
+    unsigned int slot = hash_utf8_value(utf8);
+    while (table[slot].code) {
+        if (table[slot].utf8 == utf8) {
+            return table[slot].code;
+        }
+        slot = (slot + 1) & (LOOKUP_TABLE_SIZE - 1);
+    }
+    return NULL;
 }
 
 static const letter_code *get_letter_code_for_utf8(const char *c, int *num_bytes, int *is_accent)
 {
     static letter_code single_char = { 0, 1, {0, 0, 0}, 0, {0, 0, 0} };
-    from_utf8_lookup key = { 0, NULL };
+    uint32_t key = 0;
     if (is_accent) *is_accent = 0;
     const uint8_t *uc = (const uint8_t *) c;
 
@@ -276,7 +291,7 @@ static const letter_code *get_letter_code_for_utf8(const char *c, int *num_bytes
     } else if ((uc[0] & 0xe0) == 0xc0 && (uc[1] & 0xc0) == 0x80) {
         // 2-byte character
         if (num_bytes) *num_bytes = 2;
-        key.utf8 = uc[0] | uc[1] << 8;
+        key = uc[0] | uc[1] << 8;
         if (is_combining_char(uc[0], uc[1])) {
             if (is_accent) *is_accent = 1;
             return NULL;
@@ -284,14 +299,14 @@ static const letter_code *get_letter_code_for_utf8(const char *c, int *num_bytes
     } else if ((uc[0] & 0xf0) == 0xe0 && (uc[1] & 0xc0) == 0x80 && (uc[2] & 0xc0) == 0x80) {
         // 3-byte character
         if (num_bytes) *num_bytes = 3;
-        key.utf8 = uc[0] | uc[1] << 8 | uc[2] << 16;
+        key = uc[0] | uc[1] << 8 | uc[2] << 16;
     } else {
         if (num_bytes) *num_bytes = 1;
     }
-    if (key.utf8 == 0) {
+    if (key == 0) {
         return NULL;
     }
-    return search_utf8_table(&key, data.from_utf8_table, data.utf8_table_size);
+    return search_utf8_table(key, data.from_utf8_table);
 }
 
 static const letter_code *get_letter_code_for_combining_utf8(const char *prev_char, const char *combining_char)
@@ -307,8 +322,7 @@ static const letter_code *get_letter_code_for_combining_utf8(const char *prev_ch
     }
     code |= prev_code;
 
-    from_utf8_lookup key = { code, 0 };
-    return search_utf8_table(&key, data.from_utf8_decomposed_table, data.decomposed_table_size);
+    return search_utf8_table(code, data.from_utf8_decomposed_table);
 }
 
 encoding_type encoding_determine(void)
@@ -339,6 +353,13 @@ static int is_ascii(const char *utf8_char)
     return ((uint8_t) *utf8_char & 0x80) == 0;
 }
 
+static int is_ascii_run(const void *input)
+{
+    uint64_t bytes;
+    memcpy(&bytes, input, ASCII_RUN_SIZE);
+    return (bytes & 0x8080808080808080ull) == 0;
+}
+
 int encoding_can_display(const char *utf8_char)
 {
     return is_ascii(utf8_char) || get_letter_code_for_utf8(utf8_char, NULL, NULL) != NULL;
@@ -351,10 +372,18 @@ void encoding_to_utf8(const uint8_t *input, char *output, int output_length, int
         return;
     }
     const char *max_output = &output[output_length - 1];
+    const uint8_t *input_end = &input[strlen((const char *) input)];
 
     while (*input && output < max_output) {
         uint8_t c = *input;
         if (c < 0x80) {
+            if (input_end - input >= ASCII_RUN_SIZE && max_output - output >= ASCII_RUN_SIZE &&
+                is_ascii_run(input)) {
+                memcpy(output, input, ASCII_RUN_SIZE);
+                output += ASCII_RUN_SIZE;
+                input += ASCII_RUN_SIZE;
+                continue;
+            }
             *output = c;
             ++output;
         } else {
@@ -388,9 +417,19 @@ void encoding_from_utf8(const char *input, uint8_t *output, int output_length)
 {
     const uint8_t *max_output = &output[output_length - 1];
 
+    const char *input_end = &input[strlen(input)];
+
     const char *prev_input = input;
     while (*input && output < max_output) {
         if (is_ascii(input)) {
+            if (input_end - input >= ASCII_RUN_SIZE && max_output - output >= ASCII_RUN_SIZE &&
+                is_ascii_run(input)) {
+                memcpy(output, input, ASCII_RUN_SIZE);
+                prev_input = &input[ASCII_RUN_SIZE - 1];
+                output += ASCII_RUN_SIZE;
+                input += ASCII_RUN_SIZE;
+                continue;
+            }
             *output = *input;
             prev_input = input;
             ++output;
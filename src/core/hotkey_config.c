@@ -23,6 +23,8 @@ static const char *ini_keys[] = {
     "save_city_screenshot",
     "load_file",
     "save_file",
+    "take_snapshot",
+    "restore_snapshot",
     "decrease_game_speed",
     "increase_game_speed",
     "toggle_pause",
@@ -115,6 +117,8 @@ static void init_defaults(void)
     set_mapping(KEY_TYPE_RIGHTBRACKET, KEY_MOD_CTRL, HOTKEY_SAVE_CITY_SCREENSHOT);
     set_mapping(KEY_TYPE_L, KEY_MOD_CTRL, HOTKEY_LOAD_FILE);
     set_mapping(KEY_TYPE_S, KEY_MOD_CTRL, HOTKEY_SAVE_FILE);
+    set_mapping(KEY_TYPE_F5, KEY_MOD_NONE, HOTKEY_TAKE_SNAPSHOT);
+    set_mapping(KEY_TYPE_F9, KEY_MOD_NONE, HOTKEY_RESTORE_SNAPSHOT);
     // City hotkeys
     set_mapping(KEY_TYPE_D, KEY_MOD_NONE, HOTKEY_DECREASE_GAME_SPEED);
     set_mapping(KEY_TYPE_F, KEY_MOD_NONE, HOTKEY_INCREASE_GAME_SPEED);
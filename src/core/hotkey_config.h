@@ -14,6 +14,8 @@ typedef enum {
     HOTKEY_SAVE_CITY_SCREENSHOT,
     HOTKEY_LOAD_FILE,
     HOTKEY_SAVE_FILE,
+    HOTKEY_TAKE_SNAPSHOT,
+    HOTKEY_RESTORE_SNAPSHOT,
     HOTKEY_DECREASE_GAME_SPEED,
     HOTKEY_INCREASE_GAME_SPEED,
     HOTKEY_TOGGLE_PAUSE,
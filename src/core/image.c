@@ -1,9 +1,11 @@
 #include "image.h"
 
 #include "core/buffer.h"
+#include "core/config.h"
 #include "core/file.h"
 #include "core/io.h"
 #include "core/log.h"
+#include "platform/thread.h"
 
 #include <stdlib.h>
 #include <string.h>
@@ -21,9 +23,12 @@
 #define MAIN_DATA_SIZE 30000000
 #define EMPIRE_DATA_SIZE (2000*1000*4)
 #define ENEMY_DATA_SIZE 2400000
-#define SCRATCH_DATA_SIZE 12100000
+#define MAX_CACHED_IMAGE_BYTES 8000000
+
+#define NO_CACHE_ENTRY -1
 
 #define NAME_SIZE 32
+#define MAX_BITMAPS 100
 
 enum {
     NO_EXTRA_FONT = 0,
@@ -100,40 +105,110 @@ static const char ENEMY_GRAPHICS_555[][NAME_SIZE] = {
 
 static const image DUMMY_IMAGE;
 
+/**
+ * Start offset of each row in the compressed pixel stream. No separate opaque span list is kept:
+ * from a row start, the stream itself is that list, as every run is a skip or an opaque span
+ */
+typedef struct {
+    int num_rows;
+    int offsets[];
+} row_index;
+
+typedef struct {
+    color_t *pixels;
+    int size;
+    unsigned int last_used_frame;
+    int prev;
+    int next;
+} cache_entry;
+
 static struct {
     int current_climate;
     int is_editor;
+    int main_generation;
     int fonts_enabled;
     int font_base_offset;
 
     uint16_t group_image_ids[300];
-    char bitmaps[100][200];
+    char bitmaps[MAX_BITMAPS][200];
+    io_mapped_file external_files[MAX_BITMAPS];
     image main[MAIN_ENTRIES];
     image enemy[ENEMY_ENTRIES];
     image *font;
+    row_index *main_rows[MAIN_ENTRIES];
+    row_index *enemy_rows[ENEMY_ENTRIES];
     color_t *main_data;
     color_t *empire_data;
     color_t *enemy_data;
     color_t *font_data;
-    uint8_t *tmp_data;
+    struct {
+        int lazy_decoding;
+        io_mapped_file raw_file;
+        cache_entry entries[MAIN_ENTRIES];
+        int most_recent;
+        int least_recent;
+        unsigned int current_frame;
+        platform_mutex *mutex;
+        image_cache_stats stats;
+    } cache;
 } data = { .current_climate = -1 };
 
+static int init_cache(void)
+{
+    data.cache.most_recent = NO_CACHE_ENTRY;
+    data.cache.least_recent = NO_CACHE_ENTRY;
+    for (int i = 0; i < MAIN_ENTRIES; i++) {
+        data.cache.entries[i].prev = NO_CACHE_ENTRY;
+        data.cache.entries[i].next = NO_CACHE_ENTRY;
+    }
+    data.cache.mutex = platform_mutex_create();
+    if (!data.cache.mutex) {
+        return 0;
+    }
+    data.cache.lazy_decoding = config_get(CONFIG_SCREEN_LAZY_IMAGE_DECODING);
+    if (data.cache.lazy_decoding) {
+        log_info("Lazy image decoding enabled, cache size", 0, MAX_CACHED_IMAGE_BYTES);
+    }
+    return 1;
+}
+
 int image_init(void)
 {
+    if (!init_cache()) {
+        return 0;
+    }
     data.enemy_data = (color_t *) malloc(ENEMY_DATA_SIZE);
-    data.main_data = (color_t *) malloc(MAIN_DATA_SIZE);
+    data.main_data = data.cache.lazy_decoding ? 0 : (color_t *) malloc(MAIN_DATA_SIZE);
     data.empire_data = (color_t *) malloc(EMPIRE_DATA_SIZE);
-    data.tmp_data = (uint8_t *) malloc(SCRATCH_DATA_SIZE);
-    if (!data.main_data || !data.empire_data || !data.enemy_data || !data.tmp_data) {
+    if ((!data.main_data && !data.cache.lazy_decoding) || !data.empire_data || !data.enemy_data) {
         free(data.main_data);
         free(data.empire_data);
         free(data.enemy_data);
-        free(data.tmp_data);
         return 0;
     }
     return 1;
 }
 
+static int row_index_memory(row_index **rows, int size)
+{
+    int total = 0;
+    for (int i = 0; i < size; i++) {
+        const row_index *index = platform_atomic_get_ptr((void **) &rows[i]);
+        if (index) {
+            total += (int) sizeof(row_index) + index->num_rows * (int) sizeof(int);
+        }
+    }
+    return total;
+}
+
+static void free_row_indexes(row_index **rows, int size)
+{
+    for (int i = 0; i < size; i++) {
+        free(rows[i]);
+        rows[i] = 0;
+    }
+}
+
 static void prepare_index(image *images, int size)
 {
     int offset = 4;
@@ -260,14 +335,147 @@ static void convert_images(image *images, int size, buffer *buf, color_t *dst)
 
 static void load_empire(void)
 {
-    int size = io_read_file_into_buffer(EMPIRE_555, data.tmp_data, EMPIRE_DATA_SIZE);
-    if (size != EMPIRE_DATA_SIZE / 2) {
+    io_mapped_file file;
+    if (!io_map_file(EMPIRE_555, &file) || file.size != EMPIRE_DATA_SIZE / 2) {
         log_error("unable to load empire data", EMPIRE_555, 0);
+        io_unmap_file(&file);
         return;
     }
     buffer buf;
-    buffer_init(&buf, data.tmp_data, size);
-    convert_uncompressed(&buf, size, data.empire_data);
+    buffer_init(&buf, file.data, file.size);
+    convert_uncompressed(&buf, file.size, data.empire_data);
+    io_unmap_file(&file);
+}
+
+static void unmap_external_files(void)
+{
+    for (int i = 0; i < MAX_BITMAPS; i++) {
+        io_unmap_file(&data.external_files[i]);
+    }
+}
+
+static void prepare_raw_images(image *images, int size)
+{
+    for (int i = 0; i < size; i++) {
+        if (!images[i].draw.is_external) {
+            images[i].draw.uncompressed_length /= 2;
+        }
+    }
+}
+
+static void cache_unlink(int id)
+{
+    cache_entry *entry = &data.cache.entries[id];
+    if (entry->prev != NO_CACHE_ENTRY) {
+        data.cache.entries[entry->prev].next = entry->next;
+    } else {
+        data.cache.most_recent = entry->next;
+    }
+    if (entry->next != NO_CACHE_ENTRY) {
+        data.cache.entries[entry->next].prev = entry->prev;
+    } else {
+        data.cache.least_recent = entry->prev;
+    }
+    entry->prev = NO_CACHE_ENTRY;
+    entry->next = NO_CACHE_ENTRY;
+}
+
+static void cache_push_front(int id)
+{
+    cache_entry *entry = &data.cache.entries[id];
+    entry->prev = NO_CACHE_ENTRY;
+    entry->next = data.cache.most_recent;
+    if (data.cache.most_recent != NO_CACHE_ENTRY) {
+        data.cache.entries[data.cache.most_recent].prev = id;
+    } else {
+        data.cache.least_recent = id;
+    }
+    data.cache.most_recent = id;
+}
+
+static void cache_remove(int id)
+{
+    cache_entry *entry = &data.cache.entries[id];
+    cache_unlink(id);
+    free(entry->pixels);
+    entry->pixels = 0;
+    data.cache.stats.resident_bytes -= entry->size;
+    entry->size = 0;
+}
+
+static void cache_clear(void)
+{
+    while (data.cache.least_recent != NO_CACHE_ENTRY) {
+        cache_remove(data.cache.least_recent);
+    }
+}
+
+static void cache_evict(void)
+{
+    // Images used in the current frame may still be drawn by another thread
+    while (data.cache.stats.resident_bytes > MAX_CACHED_IMAGE_BYTES &&
+           data.cache.least_recent != NO_CACHE_ENTRY &&
+           data.cache.entries[data.cache.least_recent].last_used_frame != data.cache.current_frame) {
+        cache_remove(data.cache.least_recent);
+    }
+}
+
+static color_t *decode_image(const image *img, buffer *buf, int *size)
+{
+    // Each input byte produces at most one color value
+    color_t *pixels = (color_t *) malloc((img->draw.data_length + 1) * sizeof(color_t));
+    if (!pixels) {
+        return 0;
+    }
+    int length;
+    if (img->draw.is_fully_compressed) {
+        length = convert_compressed(buf, img->draw.data_length, pixels);
+    } else if (img->draw.has_compressed_part) { // isometric tile
+        int uncompressed_bytes = img->draw.uncompressed_length * 2;
+        length = convert_uncompressed(buf, uncompressed_bytes, pixels);
+        length += convert_compressed(buf, img->draw.data_length - uncompressed_bytes, &pixels[length]);
+    } else {
+        length = convert_uncompressed(buf, img->draw.data_length, pixels);
+    }
+    *size = (length + 1) * (int) sizeof(color_t);
+    color_t *shrunk = (color_t *) realloc(pixels, *size);
+    return shrunk ? shrunk : pixels;
+}
+
+static color_t *decode_raw_image(const image *img, int *size)
+{
+    const io_mapped_file *file = &data.cache.raw_file;
+    if (img->draw.offset < 0 || img->draw.data_length < 0 ||
+        img->draw.offset + img->draw.data_length > file->size) {
+        return 0;
+    }
+    buffer buf;
+    buffer_init(&buf, file->data, file->size);
+    buffer_set(&buf, img->draw.offset);
+    return decode_image(img, &buf, size);
+}
+
+static void reset_cache(void)
+{
+    platform_mutex_lock(data.cache.mutex);
+    log_info("Image cache hits", 0, data.cache.stats.hits);
+    log_info("Image cache misses", 0, data.cache.stats.misses);
+    log_info("Row index memory for clipped images (bytes)", 0, image_row_index_memory_usage());
+    cache_clear();
+    unmap_external_files();
+    platform_mutex_unlock(data.cache.mutex);
+}
+
+static int load_raw_images(const char *filename)
+{
+    platform_mutex_lock(data.cache.mutex);
+    io_unmap_file(&data.cache.raw_file);
+    int success = io_map_file(filename, &data.cache.raw_file);
+    if (success) {
+        prepare_raw_images(data.main, MAIN_ENTRIES);
+    }
+    platform_mutex_unlock(data.cache.mutex);
+    return success;
 }
 
 int image_load_climate(int climate_id, int is_editor, int force_reload)
@@ -279,22 +487,34 @@ int image_load_climate(int climate_id, int is_editor, int force_reload)
     const char *filename_bmp = is_editor ? EDITOR_GRAPHICS_555[climate_id] : MAIN_GRAPHICS_555[climate_id];
     const char *filename_idx = is_editor ? EDITOR_GRAPHICS_SG2[climate_id] : MAIN_GRAPHICS_SG2[climate_id];
 
-    if (MAIN_INDEX_SIZE != io_read_file_into_buffer(filename_idx, data.tmp_data, MAIN_INDEX_SIZE)) {
+    io_mapped_file file;
+    if (!io_map_file(filename_idx, &file) || file.size < MAIN_INDEX_SIZE) {
+        io_unmap_file(&file);
         return 0;
     }
 
     buffer buf;
-    buffer_init(&buf, data.tmp_data, HEADER_SIZE);
+    buffer_init(&buf, file.data, HEADER_SIZE);
     read_header(&buf);
-    buffer_init(&buf, &data.tmp_data[HEADER_SIZE], ENTRY_SIZE * MAIN_ENTRIES);
+    buffer_init(&buf, &file.data[HEADER_SIZE], ENTRY_SIZE * MAIN_ENTRIES);
     read_index(&buf, data.main, MAIN_ENTRIES);
-
-    int data_size = io_read_file_into_buffer(filename_bmp, data.tmp_data, SCRATCH_DATA_SIZE);
-    if (!data_size) {
-        return 0;
+    io_unmap_file(&file);
+    data.main_generation++;
+    reset_cache();
+    free_row_indexes(data.main_rows, MAIN_ENTRIES);
+
+    if (data.cache.lazy_decoding) {
+        if (!load_raw_images(filename_bmp)) {
+            return 0;
+        }
+    } else {
+        if (!io_map_file(filename_bmp, &file)) {
+            return 0;
+        }
+        buffer_init(&buf, file.data, file.size);
+        convert_images(data.main, MAIN_ENTRIES, &buf, data.main_data);
+        io_unmap_file(&file);
     }
-    buffer_init(&buf, data.tmp_data, data_size);
-    convert_images(data.main, MAIN_ENTRIES, &buf, data.main_data);
     data.current_climate = climate_id;
     data.is_editor = is_editor;
 
@@ -307,56 +527,111 @@ int image_load_enemy(int enemy_id)
     const char *filename_bmp = ENEMY_GRAPHICS_555[enemy_id];
     const char *filename_idx = ENEMY_GRAPHICS_SG2[enemy_id];
 
-    if (ENEMY_INDEX_SIZE != io_read_file_part_into_buffer(
-        filename_idx, data.tmp_data, ENEMY_INDEX_SIZE, ENEMY_INDEX_OFFSET)) {
+    io_mapped_file file;
+    if (!io_map_file(filename_idx, &file) || file.size < ENEMY_INDEX_OFFSET + ENEMY_INDEX_SIZE) {
+        io_unmap_file(&file);
         return 0;
     }
 
     buffer buf;
-    buffer_init(&buf, data.tmp_data, ENEMY_INDEX_SIZE);
+    buffer_init(&buf, &file.data[ENEMY_INDEX_OFFSET], ENEMY_INDEX_SIZE);
     read_index(&buf, data.enemy, ENEMY_ENTRIES);
+    io_unmap_file(&file);
+    free_row_indexes(data.enemy_rows, ENEMY_ENTRIES);
 
-    int data_size = io_read_file_into_buffer(filename_bmp, data.tmp_data, SCRATCH_DATA_SIZE);
-    if (!data_size) {
+    if (!io_map_file(filename_bmp, &file)) {
         return 0;
     }
-    buffer_init(&buf, data.tmp_data, data_size);
+    buffer_init(&buf, file.data, file.size);
     convert_images(data.enemy, ENEMY_ENTRIES, &buf, data.enemy_data);
+    io_unmap_file(&file);
     return 1;
 }
 
-static const color_t *load_external_data(int image_id)
+static const io_mapped_file *map_external_file(int bitmap_id)
 {
-    image *img = &data.main[image_id];
+    io_mapped_file *file = &data.external_files[bitmap_id];
+    if (file->data) {
+        return file;
+    }
     char filename[FILE_NAME_MAX] = "555/";
-    strcpy(&filename[4], data.bitmaps[img->draw.bitmap_id]);
+    strcpy(&filename[4], data.bitmaps[bitmap_id]);
     file_change_extension(filename, "555");
-    int size = io_read_file_part_into_buffer(
-        &filename[4], data.tmp_data,
-        img->draw.data_length, img->draw.offset - 1
-    );
-    if (!size) {
+    if (!io_map_file(&filename[4], file)) {
         // try in 555 dir
-        size = io_read_file_part_into_buffer(
-            filename, data.tmp_data,
-            img->draw.data_length, img->draw.offset - 1
-        );
-        if (!size) {
-            log_error("unable to load external image",
-                      data.bitmaps[img->draw.bitmap_id], image_id);
+        if (!io_map_file(filename, file)) {
             return NULL;
         }
     }
+    return file;
+}
+
+static void release_external_file(int bitmap_id)
+{
+    // Only memory mapped files are kept: copied files would waste memory
+    if (!data.external_files[bitmap_id].is_mapped) {
+        io_unmap_file(&data.external_files[bitmap_id]);
+    }
+}
+
+static color_t *load_external_data(int image_id, int *decoded_size)
+{
+    image *img = &data.main[image_id];
+    int bitmap_id = img->draw.bitmap_id;
+    if (bitmap_id >= MAX_BITMAPS) {
+        log_error("invalid bitmap for external image", 0, image_id);
+        return NULL;
+    }
+    const io_mapped_file *file = map_external_file(bitmap_id);
+    int offset = img->draw.offset - 1;
+    if (!file || offset < 0 || offset >= file->size) {
+        log_error("unable to load external image", data.bitmaps[bitmap_id], image_id);
+        if (file) {
+            release_external_file(bitmap_id);
+        }
+        return NULL;
+    }
+    int size = file->size - offset;
+    if (size > img->draw.data_length) {
+        size = img->draw.data_length;
+    }
     buffer buf;
-    buffer_init(&buf, data.tmp_data, size);
-    color_t *dst = (color_t *) &data.tmp_data[4000000];
+    buffer_init(&buf, &file->data[offset], size);
     // NB: isometric images are never external
-    if (img->draw.is_fully_compressed) {
-        convert_compressed(&buf, img->draw.data_length, dst);
+    color_t *pixels = decode_image(img, &buf, decoded_size);
+    release_external_file(bitmap_id);
+    return pixels;
+}
+
+static const color_t *cached_image_data(int id)
+{
+    platform_mutex_lock(data.cache.mutex);
+    cache_entry *entry = &data.cache.entries[id];
+    if (entry->pixels) {
+        data.cache.stats.hits++;
+        cache_unlink(id);
     } else {
-        convert_uncompressed(&buf, img->draw.data_length, dst);
+        data.cache.stats.misses++;
+        if (data.main[id].draw.is_external) {
+            entry->pixels = load_external_data(id, &entry->size);
+        } else {
+            entry->pixels = decode_raw_image(&data.main[id], &entry->size);
+            if (!entry->pixels) {
+                log_error("unable to decode image", 0, id);
+            }
+        }
+        if (!entry->pixels) {
+            platform_mutex_unlock(data.cache.mutex);
+            return NULL;
+        }
+        data.cache.stats.resident_bytes += entry->size;
     }
-    return dst;
+    entry->last_used_frame = data.cache.current_frame;
+    cache_push_front(id);
+    cache_evict();
+    const color_t *pixels = entry->pixels;
+    platform_mutex_unlock(data.cache.mutex);
+    return pixels;
 }
 
 int image_group(int group)
@@ -401,11 +676,14 @@ const color_t *image_data(int id)
         return NULL;
     }
     if (!data.main[id].draw.is_external) {
+        if (data.cache.lazy_decoding) {
+            return cached_image_data(id);
+        }
         return &data.main_data[data.main[id].draw.offset];
     } else if (id == image_group(GROUP_EMPIRE_MAP)) {
         return data.empire_data;
     } else {
-        return load_external_data(id);
+        return cached_image_data(id);
     }
 }
 
@@ -416,8 +694,7 @@ const color_t *image_data_letter(int letter_id)
     } else if (data.fonts_enabled == MULTIBYTE_IN_FONT && letter_id >= IMAGE_FONT_MULTIBYTE_OFFSET) {
         return &data.font_data[data.font[data.font_base_offset + letter_id - IMAGE_FONT_MULTIBYTE_OFFSET].draw.offset];
     } else if (letter_id < IMAGE_FONT_MULTIBYTE_OFFSET) {
-        int image_id = data.group_image_ids[GROUP_FONT] + letter_id;
-        return &data.main_data[data.main[image_id].draw.offset];
+        return image_data(data.group_image_ids[GROUP_FONT] + letter_id);
     } else {
         return NULL;
     }
@@ -430,3 +707,86 @@ const color_t *image_data_enemy(int id)
     }
     return NULL;
 }
+
+void image_begin_frame(void)
+{
+    platform_mutex_lock(data.cache.mutex);
+    data.cache.current_frame++;
+    cache_evict();
+    platform_mutex_unlock(data.cache.mutex);
+}
+
+int image_main_generation(void)
+{
+    return data.main_generation;
+}
+
+void image_get_cache_stats(image_cache_stats *stats)
+{
+    platform_mutex_lock(data.cache.mutex);
+    *stats = data.cache.stats;
+    platform_mutex_unlock(data.cache.mutex);
+}
+
+static row_index **get_row_index_slot(const image *img)
+{
+    if (img >= data.main && img < &data.main[MAIN_ENTRIES]) {
+        return &data.main_rows[img - data.main];
+    } else if (img >= data.enemy && img < &data.enemy[ENEMY_ENTRIES]) {
+        return &data.enemy_rows[img - data.enemy];
+    }
+    return 0;
+}
+
+static row_index *build_row_index(const image *img, const color_t *pixels, int height)
+{
+    row_index *rows = (row_index *) malloc(sizeof(row_index) + height * sizeof(int));
+    if (!rows) {
+        return 0;
+    }
+    rows->num_rows = height;
+    int offset = 0;
+    for (int y = 0; y < height; y++) {
+        rows->offsets[y] = offset;
+        int x = 0;
+        while (x < img->width) {
+            color_t b = pixels[offset++];
+            if (b == 255) {
+                x += pixels[offset++];
+            } else {
+                offset += b;
+                x += b;
+            }
+        }
+    }
+    return rows;
+}
+
+const int *image_compressed_row_offsets(const image *img, const color_t *pixels, int height)
+{
+    row_index **slot = get_row_index_slot(img);
+    if (!slot) {
+        return 0;
+    }
+    row_index *rows = platform_atomic_get_ptr((void **) slot);
+    if (!rows) {
+        row_index *new_rows = build_row_index(img, pixels, height);
+        if (!new_rows) {
+            return 0;
+        }
+        if (platform_atomic_cas_ptr((void **) slot, 0, new_rows)) {
+            rows = new_rows;
+        } else {
+            // another thread built the same index first
+            free(new_rows);
+            rows = platform_atomic_get_ptr((void **) slot);
+        }
+    }
+    return rows->num_rows == height ? rows->offsets : 0;
+}
+
+int image_row_index_memory_usage(void)
+{
+    // The enemy images may still be loading on the startup thread, so only the main images are counted
+    return row_index_memory(data.main_rows, MAIN_ENTRIES);
+}
@@ -40,6 +40,15 @@ typedef struct {
     } draw;
 } image;
 
+/**
+ * Statistics of the cache of decoded external images and lazily decoded images
+ */
+typedef struct {
+    int hits;
+    int misses;
+    int resident_bytes;
+} image_cache_stats;
+
 /**
  * Initializes the image system
  */
@@ -92,7 +101,7 @@ const image *image_get_enemy(int id);
 /**
  * Gets image pixel data by id
  * @param id Image ID
- * @return Pointer to data or null, short term use only.
+ * @return Pointer to data or null, valid until the end of the current frame.
  */
 const color_t *image_data(int id);
 
@@ -110,4 +119,38 @@ const color_t *image_data_letter(int letter_id);
  */
 const color_t *image_data_enemy(int id);
 
+/**
+ * Marks the start of a new frame. Decoded images that were not used during
+ * the current frame may be evicted from the cache after this call.
+ */
+void image_begin_frame(void);
+
+/**
+ * Gets a number that changes every time the main images, including the letters, are reloaded
+ * @return Load generation of the main images
+ */
+int image_main_generation(void);
+
+/**
+ * Gets the statistics of the decoded image cache
+ * @param stats Statistics to fill
+ */
+void image_get_cache_stats(image_cache_stats *stats);
+
+/**
+ * Gets the start offset of each row of a compressed image, building the index on first use.
+ * Only images from the climate and enemy collections are indexed.
+ * @param img Image
+ * @param pixels Compressed pixel data of the image
+ * @param height Number of rows in the compressed data
+ * @return Offsets into pixels for each row, or null if no index is available
+ */
+const int *image_compressed_row_offsets(const image *img, const color_t *pixels, int height);
+
+/**
+ * Gets the memory used by the row indexes of the compressed main images
+ * @return Number of bytes used
+ */
+int image_row_index_memory_usage(void);
+
 #endif // CORE_IMAGE_H
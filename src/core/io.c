@@ -1,8 +1,11 @@
 #include "core/io.h"
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "core/file.h"
+#include "platform/file_manager.h"
 
 int io_read_file_into_buffer(const char *filepath, void *buffer, int max_size)
 {
@@ -56,5 +59,54 @@ int io_write_buffer_to_file(const char *filepath, const void *buffer, int size)
     }
     int bytes_written = (int) fwrite(buffer, 1, (size_t) size, fp);
     file_close(fp);
+    dir_invalidate_cache();
     return bytes_written;
 }
+
+int io_map_file(const char *filepath, io_mapped_file *file)
+{
+    memset(file, 0, sizeof(io_mapped_file));
+    const char *cased_file = get_case_corrected_file(0, filepath);
+    if (!cased_file) {
+        return 0;
+    }
+    FILE *fp = file_open(cased_file, "rb");
+    if (!fp) {
+        return 0;
+    }
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    if (size <= 0 || size > INT32_MAX) {
+        file_close(fp);
+        return 0;
+    }
+    uint8_t *data = (uint8_t *) platform_file_manager_map_file(fp, (size_t) size);
+    if (data) {
+        file->is_mapped = 1;
+    } else {
+        data = (uint8_t *) malloc((size_t) size);
+        fseek(fp, 0, SEEK_SET);
+        if (!data || fread(data, 1, (size_t) size, fp) != (size_t) size) {
+            free(data);
+            file_close(fp);
+            return 0;
+        }
+    }
+    file_close(fp);
+    file->data = data;
+    file->size = (int) size;
+    return 1;
+}
+
+void io_unmap_file(io_mapped_file *file)
+{
+    if (!file->data) {
+        return;
+    }
+    if (file->is_mapped) {
+        platform_file_manager_unmap_file(file->data, (size_t) file->size);
+    } else {
+        free(file->data);
+    }
+    memset(file, 0, sizeof(io_mapped_file));
+}
@@ -3,11 +3,22 @@
 
 #include "core/dir.h"
 
+#include <stdint.h>
+
 /**
  * @file
  * I/O functions.
  */
 
+/**
+ * Contents of a file mapped into memory
+ */
+typedef struct {
+    uint8_t *data; /**< Read-only: file contents */
+    int size; /**< Read-only: file size */
+    int is_mapped; /**< Read-only: whether the contents are memory mapped or copied */
+} io_mapped_file;
+
 /**
  * Reads the entire file into the buffer
  * @param filepath File to read
@@ -35,4 +46,19 @@ int io_read_file_part_into_buffer(const char *filepath, void *buffer, int size,
  */
 int io_write_buffer_to_file(const char *filepath, const void *buffer, int size);
 
+/**
+ * Maps the entire file into memory. When the file cannot be memory mapped,
+ * its contents are read into an allocated buffer instead.
+ * @param filepath File to map
+ * @param file Mapped file to fill
+ * @return boolean true on success, false if the file does not exist or could not be read
+ */
+int io_map_file(const char *filepath, io_mapped_file *file);
+
+/**
+ * Releases a file mapped by io_map_file. Does nothing if the file is not mapped.
+ * @param file Mapped file to release
+ */
+void io_unmap_file(io_mapped_file *file);
+
 #endif // CORE_IO_H
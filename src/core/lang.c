@@ -7,100 +7,124 @@
 #include "core/string.h"
 #include "game/custom_strings.h"
 
-#include <stdlib.h>
 #include <string.h>
 
 #define MAX_TEXT_ENTRIES 1000
 #define MAX_TEXT_DATA 200000
-#define MIN_TEXT_SIZE (28 + MAX_TEXT_ENTRIES * 8)
+#define TEXT_HEADER_SIZE 28
+#define TEXT_ENTRY_SIZE 8
+#define MIN_TEXT_SIZE (TEXT_HEADER_SIZE + MAX_TEXT_ENTRIES * TEXT_ENTRY_SIZE)
 #define MAX_TEXT_SIZE (MIN_TEXT_SIZE + MAX_TEXT_DATA)
 
 #define MAX_MESSAGE_ENTRIES 400
 #define MAX_MESSAGE_DATA 460000
-#define MIN_MESSAGE_SIZE 32024
+#define MESSAGE_HEADER_SIZE 24
+#define MESSAGE_ENTRY_SIZE 80
+#define MIN_MESSAGE_SIZE (MESSAGE_HEADER_SIZE + MAX_MESSAGE_ENTRIES * MESSAGE_ENTRY_SIZE)
 #define MAX_MESSAGE_SIZE (MIN_MESSAGE_SIZE + MAX_MESSAGE_DATA)
 
-#define BUFFER_SIZE 400000
-
 #define FILE_TEXT_ENG "c3.eng"
 #define FILE_MM_ENG "c3_mm.eng"
 #define FILE_EDITOR_TEXT_ENG "c3_map.eng"
 #define FILE_EDITOR_MM_ENG "c3_map_mm.eng"
 
-static struct {
-    struct {
-        int32_t offset;
-        int32_t in_use;
-    } text_entries[MAX_TEXT_ENTRIES];
-    uint8_t text_data[MAX_TEXT_DATA];
+#define FIRST_CUSTOM_MESSAGE 321
 
+/**
+ * Language files stay mapped and messages are only decoded when they are first used,
+ * so switching between the game and the editor does not read or parse anything again.
+ */
+typedef struct {
+    int loaded;
+    io_mapped_file text_file;
+    io_mapped_file message_file;
     lang_message message_entries[MAX_MESSAGE_ENTRIES];
-    uint8_t message_data[MAX_MESSAGE_DATA];
+    uint8_t message_decoded[MAX_MESSAGE_ENTRIES];
+    int custom_message_id;
+} lang_files;
+
+static struct {
+    lang_files files[2]; // game, editor
+    int current;
 } data;
 
-static void parse_text(buffer *buf)
+static const uint8_t EMPTY_STRING[] = { 0 };
+
+static lang_files *current_files(void)
 {
-    buffer_skip(buf, 28); // header
-    for (int i = 0; i < MAX_TEXT_ENTRIES; i++) {
-        data.text_entries[i].offset = buffer_read_i32(buf);
-        data.text_entries[i].in_use = buffer_read_i32(buf);
-    }
-    buffer_read_raw(buf, data.text_data, MAX_TEXT_DATA);
+    return &data.files[data.current];
 }
 
-static int load_text(const char *filename, uint8_t *buf_data)
+static int map_file(const char *filename, io_mapped_file *file, int min_size, int max_size)
 {
-    buffer buf;
-    int filesize = io_read_file_into_buffer(filename, buf_data, BUFFER_SIZE);
-    if (filesize < MIN_TEXT_SIZE || filesize > MAX_TEXT_SIZE) {
+    if (!io_map_file(filename, file)) {
+        return 0;
+    }
+    if (file->size < min_size || file->size > max_size) {
+        io_unmap_file(file);
         return 0;
     }
-    buffer_init(&buf, buf_data, filesize);
-    parse_text(&buf);
     return 1;
 }
 
-static uint8_t *get_message_text(int32_t offset)
+static uint8_t *get_message_text(const io_mapped_file *file, int32_t offset)
 {
-    if (!offset) {
+    int data_size = file->size - MIN_MESSAGE_SIZE;
+    if (offset <= 0 || offset >= data_size) {
+        return 0;
+    }
+    uint8_t *text = &file->data[MIN_MESSAGE_SIZE + offset];
+    // Make sure the text ends within the file
+    if (!memchr(text, 0, data_size - offset)) {
         return 0;
     }
-    return &data.message_data[offset];
+    return text;
+}
+
+static void parse_message(const io_mapped_file *file, int id, lang_message *m)
+{
+    buffer buf;
+    buffer_init(&buf, &file->data[MESSAGE_HEADER_SIZE + id * MESSAGE_ENTRY_SIZE], MESSAGE_ENTRY_SIZE);
+    m->type = buffer_read_i16(&buf);
+    m->message_type = buffer_read_i16(&buf);
+    buffer_skip(&buf, 2);
+    m->x = buffer_read_i16(&buf);
+    m->y = buffer_read_i16(&buf);
+    m->width_blocks = buffer_read_i16(&buf);
+    m->height_blocks = buffer_read_i16(&buf);
+    m->image.id = buffer_read_i16(&buf);
+    m->image.x = buffer_read_i16(&buf);
+    m->image.y = buffer_read_i16(&buf);
+    buffer_skip(&buf, 6); // unused image2 id, x, y
+    m->title.x = buffer_read_i16(&buf);
+    m->title.y = buffer_read_i16(&buf);
+    m->subtitle.x = buffer_read_i16(&buf);
+    m->subtitle.y = buffer_read_i16(&buf);
+    buffer_skip(&buf, 4);
+    m->video.x = buffer_read_i16(&buf);
+    m->video.y = buffer_read_i16(&buf);
+    buffer_skip(&buf, 14);
+    m->urgent = buffer_read_i32(&buf);
+
+    m->video.text = get_message_text(file, buffer_read_i32(&buf));
+    buffer_skip(&buf, 4);
+    m->title.text = get_message_text(file, buffer_read_i32(&buf));
+    m->subtitle.text = get_message_text(file, buffer_read_i32(&buf));
+    m->content.text = get_message_text(file, buffer_read_i32(&buf));
 }
 
-static void parse_message(buffer *buf)
+static lang_message *get_message(int id)
 {
-    buffer_skip(buf, 24); // header
-    for (int i = 0; i < MAX_MESSAGE_ENTRIES; i++) {
-        lang_message *m = &data.message_entries[i];
-        m->type = buffer_read_i16(buf);
-        m->message_type = buffer_read_i16(buf);
-        buffer_skip(buf, 2);
-        m->x = buffer_read_i16(buf);
-        m->y = buffer_read_i16(buf);
-        m->width_blocks = buffer_read_i16(buf);
-        m->height_blocks = buffer_read_i16(buf);
-        m->image.id = buffer_read_i16(buf);
-        m->image.x = buffer_read_i16(buf);
-        m->image.y = buffer_read_i16(buf);
-        buffer_skip(buf, 6); // unused image2 id, x, y
-        m->title.x = buffer_read_i16(buf);
-        m->title.y = buffer_read_i16(buf);
-        m->subtitle.x = buffer_read_i16(buf);
-        m->subtitle.y = buffer_read_i16(buf);
-        buffer_skip(buf, 4);
-        m->video.x = buffer_read_i16(buf);
-        m->video.y = buffer_read_i16(buf);
-        buffer_skip(buf, 14);
-        m->urgent = buffer_read_i32(buf);
-
-        m->video.text = get_message_text(buffer_read_i32(buf));
-        buffer_skip(buf, 4);
-        m->title.text = get_message_text(buffer_read_i32(buf));
-        m->subtitle.text = get_message_text(buffer_read_i32(buf));
-        m->content.text = get_message_text(buffer_read_i32(buf));
+    lang_files *files = current_files();
+    lang_message *m = &files->message_entries[id];
+    if (!files->message_decoded[id]) {
+        files->message_decoded[id] = 1;
+        memset(m, 0, sizeof(lang_message));
+        if (files->loaded) {
+            parse_message(&files->message_file, id, m);
+        }
     }
-    buffer_read_raw(buf, &data.message_data, MAX_MESSAGE_DATA);
+    return m;
 }
 
 static void set_message_parameters(lang_message *m, int title, int text, int urgent, int message_type)
@@ -121,79 +145,100 @@ static void set_message_parameters(lang_message *m, int title, int text, int urg
 
 void load_custom_messages(void)
 {
-    int i = 321;
-    while (i < MAX_MESSAGE_ENTRIES) {
-        if (!data.message_entries[i].content.text) {
-            break;
+    lang_files *files = current_files();
+    // The files stay loaded, so the custom messages only have to be placed once
+    int i = files->custom_message_id;
+    if (!i) {
+        i = FIRST_CUSTOM_MESSAGE;
+        while (i < MAX_MESSAGE_ENTRIES) {
+            if (!get_message(i)->content.text) {
+                break;
+            }
+            i++;
         }
-        i++;
     }
 
     if (i >= MAX_MESSAGE_ENTRIES) {
         log_error("Message entry max exceeded", "", 0);
         return;
     }
+    files->custom_message_id = i;
 
     // distant battle won but triumphal arch disabled from the editor
-    lang_message *m = &data.message_entries[i];
+    lang_message *m = get_message(i);
     set_message_parameters(m, TR_CITY_MESSAGE_TITLE_DISTANT_BATTLE_WON_TRIUMPHAL_ARCH_DISABLED, TR_CITY_MESSAGE_TEXT_DISTANT_BATTLE_WON_TRIUMPHAL_ARCH_DISABLED, 0,
         MESSAGE_TYPE_GENERAL);
     m->video.text = (uint8_t *) "smk/army_win.smk";
     i += 1;
 }
 
-
-static int load_message(const char *filename, uint8_t *data_buffer)
+static int load_files(int is_editor, const char *text_filename, const char *message_filename)
 {
-    buffer buf;
-    int filesize = io_read_file_into_buffer(filename, data_buffer, BUFFER_SIZE);
-    if (filesize < MIN_MESSAGE_SIZE || filesize > MAX_MESSAGE_SIZE) {
-        return 0;
+    lang_files *files = &data.files[is_editor];
+    if (!files->loaded) {
+        io_mapped_file text_file;
+        io_mapped_file message_file;
+        if (!map_file(text_filename, &text_file, MIN_TEXT_SIZE, MAX_TEXT_SIZE)) {
+            return 0;
+        }
+        if (!map_file(message_filename, &message_file, MIN_MESSAGE_SIZE, MAX_MESSAGE_SIZE)) {
+            io_unmap_file(&text_file);
+            return 0;
+        }
+        files->text_file = text_file;
+        files->message_file = message_file;
+        memset(files->message_decoded, 0, sizeof(files->message_decoded));
+        files->custom_message_id = 0;
+        files->loaded = 1;
     }
-    buffer_init(&buf, data_buffer, filesize);
-    parse_message(&buf);
+    data.current = is_editor;
     return 1;
 }
 
-static int load_files(const char *text_filename, const char *message_filename)
-{
-    uint8_t *buffer = (uint8_t *) malloc(BUFFER_SIZE);
-    if (!buffer) {
-        return 0;
-    }
-    int success = load_text(text_filename, buffer) && load_message(message_filename, buffer);
-    free(buffer);
-    return success;
-}
-
 int lang_load(int is_editor)
 {
     if (is_editor) {
-        return load_files(FILE_EDITOR_TEXT_ENG, FILE_EDITOR_MM_ENG);
+        return load_files(1, FILE_EDITOR_TEXT_ENG, FILE_EDITOR_MM_ENG);
     }
     return
-        load_files(FILE_TEXT_ENG, FILE_MM_ENG) ||
-        load_files(FILE_TEXT_ENG, FILE_MM_ENG);
+        load_files(0, FILE_TEXT_ENG, FILE_MM_ENG) ||
+        load_files(0, FILE_TEXT_ENG, FILE_MM_ENG);
 }
 
 const uint8_t *lang_get_string(int group, int index)
 {
-    const uint8_t *str = &data.text_data[data.text_entries[group].offset];
+    const lang_files *files = current_files();
+    if (!files->loaded || group < 0 || group >= MAX_TEXT_ENTRIES) {
+        return EMPTY_STRING;
+    }
+    buffer buf;
+    buffer_init(&buf, &files->text_file.data[TEXT_HEADER_SIZE + group * TEXT_ENTRY_SIZE], TEXT_ENTRY_SIZE);
+    int32_t offset = buffer_read_i32(&buf);
+    const uint8_t *text_data = &files->text_file.data[MIN_TEXT_SIZE];
+    const uint8_t *end = &text_data[files->text_file.size - MIN_TEXT_SIZE];
+    if (offset < 0 || offset >= end - text_data) {
+        return EMPTY_STRING;
+    }
+    const uint8_t *str = &text_data[offset];
     uint8_t prev = 0;
-    while (index > 0) {
+    while (index > 0 && str < end) {
         if (!*str && (prev >= ' ' || prev == 0)) {
             --index;
         }
         prev = *str;
         ++str;
     }
-    while (*str < ' ') { // skip non-printables
+    while (str < end && *str < ' ') { // skip non-printables
         ++str;
     }
+    // Make sure the string ends within the file
+    if (str >= end || !memchr(str, 0, end - str)) {
+        return EMPTY_STRING;
+    }
     return str;
 }
 
 const lang_message *lang_get_message(int id)
 {
-    return &data.message_entries[id];
+    return get_message(id);
 }
@@ -1,7 +1,8 @@
 #include "smacker.h"
 
-#include "core/file.h"
+#include "core/io.h"
 #include "core/log.h"
+#include "platform/thread.h"
 
 #include <stdint.h>
 #include <stdlib.h>
@@ -30,36 +31,60 @@
 #define BLOCK_VOID 2
 #define BLOCK_SOLID 3
 
+#define FRAME_QUEUE_SIZE 8
+
+#define TREE8_LOOKUP_BITS 10
+#define TREE16_LOOKUP_BITS 12
+#define MIN_TREE_NODES 64
+#define MAX_TREE8_NODES 512
+
 typedef struct {
     const uint8_t *data;
     int length;
     int index;
-    int bit_index;
+    uint64_t bits;
+    int bits_left;
 } bitstream;
 
-typedef struct huffnode8_t {
-    struct huffnode8_t *b[2];
+typedef struct {
+    int32_t child[2];
     int is_leaf;
-    uint8_t value;
-} huffnode8;
+} huffnode;
 
-typedef struct hufftree8_t {
-    huffnode8 nodes[512];
-    int size;
-} hufftree8;
+typedef struct {
+    int32_t value;
+    uint8_t length;
+    uint8_t is_leaf;
+} hufflookup;
 
-typedef struct huffnode16_t {
-    struct huffnode16_t *b[2];
-    int is_leaf;
-    uint16_t value;
-} huffnode16;
+/**
+ * Huffman tree with all nodes in one array and a lookup table for the first bits.
+ * Leaves keep their value in child[0]. A lookup entry either holds the value of
+ * the leaf reached within the table bits, or the node where the code continues.
+ */
+typedef struct {
+    huffnode *nodes;
+    int num_nodes;
+    int max_nodes;
+    int max_depth;
+    hufflookup *lookup;
+    int lookup_bits;
+    int lookup_size;
+} hufftree;
 
-typedef struct hufftree16_t {
-    huffnode16 *root;
-    hufftree8 *low;
-    hufftree8 *high;
+/**
+ * 16-bit tree: the leaves of the tree refer to a slot in values. The three
+ * escape codes have their own slot, shared with the leaf that has their code.
+ */
+typedef struct {
+    hufftree tree;
+    hufftree low;
+    hufftree high;
     uint16_t escape_codes[3];
-    huffnode16 *escape_nodes[3];
+    int escape_slots[3];
+    uint16_t *values;
+    int num_values;
+    int max_values;
 } hufftree16;
 
 typedef struct {
@@ -70,7 +95,8 @@ typedef struct {
 } frame_data_t;
 
 struct smacker_t {
-    FILE *fp;
+    io_mapped_file file;
+    int file_offset;
 
     int32_t width;
     int32_t height;
@@ -81,8 +107,8 @@ struct smacker_t {
     int32_t audio_size[7];
     int32_t audio_rate[7];
 
-    long frame_data_offset_in_file;
-    long *frame_offsets;
+    int frame_data_offset_in_file;
+    int *frame_offsets;
     int32_t *frame_sizes;
     uint8_t *frame_types;
 
@@ -90,21 +116,23 @@ struct smacker_t {
     hufftree16 *mclr_tree;
     hufftree16 *full_tree;
     hufftree16 *type_tree;
+    hufftree audio_trees[4];
 
     frame_data_t frame_data;
     int32_t current_frame;
-};
-
-static const uint8_t BIT_MASKS[] = {
-    0x00,
-    0x01,
-    0x03,
-    0x07,
-    0x0f,
-    0x1f,
-    0x3f,
-    0x7f,
-    0xff,
+    const frame_data_t *current;
+
+    struct {
+        platform_thread *thread;
+        platform_mutex *mutex;
+        platform_condition *frame_ready;
+        platform_condition *slot_free;
+        frame_data_t frames[FRAME_QUEUE_SIZE];
+        smacker_frame_status status[FRAME_QUEUE_SIZE];
+        int head;
+        int count;
+        int quit;
+    } queue;
 };
 
 static const uint8_t PALETTE_MAP[64] = {
@@ -138,7 +166,7 @@ static inline void *clear_malloc(size_t s)
     return buf;
 }
 
-static int32_t read_i32(uint8_t *data)
+static int32_t read_i32(const uint8_t *data)
 {
     return (int32_t) (data[0] | (data[1] << 8) | (data[2] << 16) | (data[3] << 24));
 }
@@ -150,200 +178,291 @@ static bitstream *bitstream_init(bitstream *bs, const uint8_t *data, int len)
     bs->data = data;
     bs->length = len;
     bs->index = 0;
-    bs->bit_index = 0;
+    bs->bits = 0;
+    bs->bits_left = 0;
     return bs;
 }
 
-static inline int read_bit(bitstream *bs)
+static inline void bitstream_refill(bitstream *bs)
 {
-    if (bs->index >= bs->length) {
-        return 0;
+    while (bs->bits_left <= 56 && bs->index < bs->length) {
+        bs->bits |= (uint64_t) bs->data[bs->index++] << bs->bits_left;
+        bs->bits_left += 8;
     }
-    int result = bs->data[bs->index] & (1 << bs->bit_index);
-    if (++bs->bit_index >= 8) {
-        bs->index++;
-        bs->bit_index = 0;
+}
+
+// Must be called after a refill: skipping more bits than available only happens at the end of the data
+static inline void skip_bits(bitstream *bs, int count)
+{
+    if (count > bs->bits_left) {
+        bs->bits = 0;
+        bs->bits_left = 0;
+        return;
     }
-    return result ? 1 : 0;
+    bs->bits >>= count;
+    bs->bits_left -= count;
 }
 
-static inline uint8_t read_byte(bitstream *bs)
+static inline int read_bit(bitstream *bs)
 {
-    if (bs->bit_index == 0) {
-        // special case: on exact byte boundary
-        if (bs->index < bs->length) {
-            return bs->data[bs->index++];
-        } else {
+    if (!bs->bits_left) {
+        bitstream_refill(bs);
+        if (!bs->bits_left) {
             return 0;
         }
     }
-    if (bs->index + 1 >= bs->length) {
+    int result = (int) (bs->bits & 1);
+    bs->bits >>= 1;
+    bs->bits_left--;
+    return result;
+}
+
+static inline uint8_t read_byte(bitstream *bs)
+{
+    bitstream_refill(bs);
+    if (bs->bits_left < 8) {
+        // Less than a full byte left: the bits stay available for read_bit
         return 0;
     }
-    uint8_t value = bs->data[bs->index] >> bs->bit_index;
-    bs->index++;
-    value |= (bs->data[bs->index] & BIT_MASKS[bs->bit_index]) << (8 - bs->bit_index);
+    uint8_t value = (uint8_t) bs->bits;
+    bs->bits >>= 8;
+    bs->bits_left -= 8;
     return value;
 }
 
-// 8-bit huffman tree functions
+// Huffman tree functions
 
-static huffnode8 *build_tree8_nodes(bitstream *bs, hufftree8 *tree)
+static int32_t add_node(hufftree *tree, int depth)
 {
-    huffnode8 *node = &tree->nodes[tree->size++];
-    if (read_bit(bs)) {
-        node->is_leaf = 0;
-        node->b[0] = build_tree8_nodes(bs, tree);
-        node->b[1] = build_tree8_nodes(bs, tree);
-    } else {
-        node->is_leaf = 1;
-        node->value = read_byte(bs);
+    if (tree->num_nodes >= tree->max_nodes) {
+        int max_nodes = tree->max_nodes ? 2 * tree->max_nodes : MIN_TREE_NODES;
+        huffnode *nodes = (huffnode *) realloc(tree->nodes, sizeof(huffnode) * max_nodes);
+        if (!nodes) {
+            log_error("SMK: no memory for huffman tree", 0, 0);
+            return -1;
+        }
+        tree->nodes = nodes;
+        tree->max_nodes = max_nodes;
+    }
+    if (depth > tree->max_depth) {
+        tree->max_depth = depth;
     }
-    return node;
+    return tree->num_nodes++;
 }
 
-static hufftree8 *create_tree8(bitstream *bs)
+static void fill_lookup_table(hufftree *tree, int32_t index, int depth, int code)
 {
-    if (read_bit(bs)) {
-        hufftree8 *tree = (hufftree8 *) clear_malloc(sizeof(hufftree8));
-        if (!tree) {
-            log_error("SMK: no memory for 8-bit tree", 0, 0);
-            return NULL;
-        }
-        build_tree8_nodes(bs, tree);
-        if (read_bit(bs) != 0) {
-            log_error("SMK: 8-bit tree not closed", 0, 0);
-            free(tree);
-            return NULL;
-        }
-        return tree;
+    const huffnode *node = &tree->nodes[index];
+    if (node->is_leaf || depth == tree->lookup_bits) {
+        hufflookup entry = { node->is_leaf ? node->child[0] : index, (uint8_t) depth, (uint8_t) node->is_leaf };
+        for (int i = code; i < 1 << tree->lookup_bits; i += 1 << depth) {
+            tree->lookup[i] = entry;
+        }
     } else {
-        log_info("SMK: WARN: no 8-bit tree found", 0, 0);
-        return NULL;
+        fill_lookup_table(tree, node->child[0], depth + 1, code);
+        fill_lookup_table(tree, node->child[1], depth + 1, code | (1 << depth));
     }
 }
 
-static void free_tree8(hufftree8 *tree)
+static int build_lookup_table(hufftree *tree, int max_bits)
 {
-    free(tree);
+    tree->lookup_bits = tree->max_depth < max_bits ? tree->max_depth : max_bits;
+    int size = 1 << tree->lookup_bits;
+    if (size > tree->lookup_size) {
+        hufflookup *lookup = (hufflookup *) realloc(tree->lookup, sizeof(hufflookup) * size);
+        if (!lookup) {
+            log_error("SMK: no memory for huffman lookup table", 0, 0);
+            return 0;
+        }
+        tree->lookup = lookup;
+        tree->lookup_size = size;
+    }
+    fill_lookup_table(tree, 0, 0, 0);
+    return 1;
 }
 
-static uint8_t lookup_tree8(bitstream *bs, hufftree8 *tree)
+static void free_tree(hufftree *tree)
 {
-    huffnode8 *node = &tree->nodes[0];
+    free(tree->nodes);
+    free(tree->lookup);
+    memset(tree, 0, sizeof(hufftree));
+}
+
+static int32_t lookup_tree(bitstream *bs, const hufftree *tree)
+{
+    if (bs->bits_left < tree->lookup_bits) {
+        bitstream_refill(bs);
+    }
+    const hufflookup *entry = &tree->lookup[bs->bits & ((1 << tree->lookup_bits) - 1)];
+    skip_bits(bs, entry->length);
+    if (entry->is_leaf) {
+        return entry->value;
+    }
+    // Code is longer than the lookup table: walk the rest of the tree
+    const huffnode *node = &tree->nodes[entry->value];
     while (!node->is_leaf) {
-        node = node->b[read_bit(bs)];
+        node = &tree->nodes[node->child[read_bit(bs)]];
     }
-    return node->value;
+    return node->child[0];
 }
 
-// 16-bit huffman tree functions
+// 8-bit huffman tree functions
 
-static void free_node16(huffnode16 *node)
+static int32_t build_tree8_nodes(bitstream *bs, hufftree *tree, int depth)
 {
-    if (!node) {
-        return;
+    if (tree->num_nodes >= MAX_TREE8_NODES) {
+        log_error("SMK: 8-bit tree too large", 0, 0);
+        return -1;
+    }
+    int32_t index = add_node(tree, depth);
+    if (index < 0) {
+        return -1;
+    }
+    if (read_bit(bs)) {
+        int32_t child0 = build_tree8_nodes(bs, tree, depth + 1);
+        if (child0 < 0) {
+            return -1;
+        }
+        int32_t child1 = build_tree8_nodes(bs, tree, depth + 1);
+        if (child1 < 0) {
+            return -1;
+        }
+        tree->nodes[index].is_leaf = 0;
+        tree->nodes[index].child[0] = child0;
+        tree->nodes[index].child[1] = child1;
+    } else {
+        tree->nodes[index].is_leaf = 1;
+        tree->nodes[index].child[0] = read_byte(bs);
+    }
+    return index;
+}
+
+/**
+ * Reads an 8-bit tree, reusing the memory of the tree passed in
+ */
+static int read_tree8(bitstream *bs, hufftree *tree)
+{
+    if (!read_bit(bs)) {
+        log_info("SMK: WARN: no 8-bit tree found", 0, 0);
+        return 0;
     }
-    if (!node->is_leaf) {
-        free_node16(node->b[0]);
-        free_node16(node->b[1]);
+    tree->num_nodes = 0;
+    tree->max_depth = 0;
+    if (build_tree8_nodes(bs, tree, 0) < 0) {
+        return 0;
+    }
+    if (read_bit(bs) != 0) {
+        log_error("SMK: 8-bit tree not closed", 0, 0);
+        return 0;
     }
-    free(node);
+    return build_lookup_table(tree, TREE8_LOOKUP_BITS);
+}
+
+static inline uint8_t lookup_tree8(bitstream *bs, const hufftree *tree)
+{
+    return (uint8_t) lookup_tree(bs, tree);
 }
 
+// 16-bit huffman tree functions
+
 static void free_tree16(hufftree16 *tree)
 {
     if (!tree) {
         return;
     }
-    for (int i = 0; i < 3; i++) {
-        if (!tree->escape_nodes[i]->is_leaf) {
-            // Free manually allocated node because it's not in the tree
-            free(tree->escape_nodes[i]);
+    free_tree(&tree->tree);
+    free_tree(&tree->low);
+    free_tree(&tree->high);
+    free(tree->values);
+    free(tree);
+}
+
+static int add_value16(hufftree16 *tree, uint16_t value)
+{
+    if (tree->num_values >= tree->max_values) {
+        int max_values = tree->max_values ? 2 * tree->max_values : MIN_TREE_NODES;
+        uint16_t *values = (uint16_t *) realloc(tree->values, sizeof(uint16_t) * max_values);
+        if (!values) {
+            log_error("SMK: no memory for 16-bit tree values", 0, 0);
+            return -1;
         }
+        tree->values = values;
+        tree->max_values = max_values;
     }
-    free_node16(tree->root);
-    free_tree8(tree->low);
-    free_tree8(tree->high);
-    free(tree);
+    tree->values[tree->num_values] = value;
+    return tree->num_values++;
 }
 
-static huffnode16 *build_tree16_nodes(bitstream *bs, hufftree16 *tree)
+static int32_t build_tree16_nodes(bitstream *bs, hufftree16 *tree, int depth)
 {
-    huffnode16 *node = (huffnode16 *) clear_malloc(sizeof(huffnode16));
-    if (!node) {
-        log_error("SMK: no memory for 16-bit tree node", 0, 0);
-        return NULL;
+    int32_t index = add_node(&tree->tree, depth);
+    if (index < 0) {
+        return -1;
     }
     if (read_bit(bs)) {
-        node->is_leaf = 0;
-        node->b[0] = build_tree16_nodes(bs, tree);
-        if (!node->b[0]) {
-            free(node);
-            return NULL;
-        }
-        node->b[1] = build_tree16_nodes(bs, tree);
-        if (!node->b[1]) {
-            free_node16(node->b[0]);
-            free(node);
-            return NULL;
+        int32_t child0 = build_tree16_nodes(bs, tree, depth + 1);
+        if (child0 < 0) {
+            return -1;
+        }
+        int32_t child1 = build_tree16_nodes(bs, tree, depth + 1);
+        if (child1 < 0) {
+            return -1;
         }
+        tree->tree.nodes[index].is_leaf = 0;
+        tree->tree.nodes[index].child[0] = child0;
+        tree->tree.nodes[index].child[1] = child1;
     } else {
-        node->is_leaf = 1;
-        uint8_t lo_val = lookup_tree8(bs, tree->low);
-        uint8_t hi_val = lookup_tree8(bs, tree->high);
+        uint8_t lo_val = lookup_tree8(bs, &tree->low);
+        uint8_t hi_val = lookup_tree8(bs, &tree->high);
         uint16_t leaf_value = lo_val | (hi_val << 8);
-        node->value = leaf_value;
+        int slot = add_value16(tree, leaf_value);
+        if (slot < 0) {
+            return -1;
+        }
+        tree->tree.nodes[index].is_leaf = 1;
+        tree->tree.nodes[index].child[0] = slot;
 
         for (int i = 0; i < 3; i++) {
             if (leaf_value == tree->escape_codes[i]) {
-                tree->escape_nodes[i] = node;
+                tree->escape_slots[i] = slot;
             }
         }
     }
-    return node;
+    return index;
 }
 
-static hufftree16 *create_tree16(bitstream *bs, hufftree8 *low, hufftree8 *high)
+static int read_tree16(bitstream *bs, hufftree16 *tree)
 {
-    hufftree16 *tree = (hufftree16 *) clear_malloc(sizeof(hufftree16));
-    if (!tree) {
-        log_error("SMK: no memory for 16-bit tree", 0, 0);
-        return NULL;
-    }
-    tree->low = low;
-    tree->high = high;
     for (int i = 0; i < 3; i++) {
         // Do not join the following two lines as it results in an optimization bug for MSVC. See PR #215
         tree->escape_codes[i] = read_byte(bs);
         tree->escape_codes[i] |= read_byte(bs) << 8;
+        tree->escape_slots[i] = -1;
     }
-    tree->root = build_tree16_nodes(bs, tree);
-    if (!tree->root) {
-        free(tree);
-        return NULL;
+    if (build_tree16_nodes(bs, tree, 0) < 0) {
+        return 0;
     }
     if (read_bit(bs) != 0) {
         log_error("SMK: 16-bit tree not closed", 0, 0);
-        free_tree16(tree);
-        return NULL;
+        return 0;
     }
     for (int i = 0; i < 3; i++) {
-        if (!tree->escape_nodes[i]) {
-            // Escape node is not in the tree: create a dummy node
-            tree->escape_nodes[i] = (huffnode16 *) clear_malloc(sizeof(huffnode16));
-            tree->escape_nodes[i]->is_leaf = 0;
-            tree->escape_nodes[i]->value = 0;
+        if (tree->escape_slots[i] < 0) {
+            // Escape code is not in the tree: give it a slot of its own
+            tree->escape_slots[i] = add_value16(tree, 0);
+            if (tree->escape_slots[i] < 0) {
+                return 0;
+            }
         }
     }
-    return tree;
+    return build_lookup_table(&tree->tree, TREE16_LOOKUP_BITS);
 }
 
 static void reset_escape16(hufftree16 *tree)
 {
     if (tree) {
         for (int i = 0; i < 3; i++) {
-            tree->escape_nodes[i]->value = 0;
+            tree->values[tree->escape_slots[i]] = 0;
         }
     }
 }
@@ -353,37 +472,38 @@ static uint16_t lookup_tree16(bitstream *bs, hufftree16 *tree)
     if (!tree) {
         return 0;
     }
-    huffnode16 *node = tree->root;
-    while (!node->is_leaf) {
-        node = node->b[read_bit(bs)];
-    }
-
-    uint16_t value = node->value;
-    if (value != tree->escape_nodes[0]->value) {
-        tree->escape_nodes[2]->value = tree->escape_nodes[1]->value;
-        tree->escape_nodes[1]->value = tree->escape_nodes[0]->value;
-        tree->escape_nodes[0]->value = value;
+    uint16_t *values = tree->values;
+    const int *escape = tree->escape_slots;
+    uint16_t value = values[lookup_tree(bs, &tree->tree)];
+    if (value != values[escape[0]]) {
+        values[escape[2]] = values[escape[1]];
+        values[escape[1]] = values[escape[0]];
+        values[escape[0]] = value;
     }
     return value;
 }
 
 static hufftree16 *read_header_tree(bitstream *bs)
 {
-    if (read_bit(bs)) {
-        hufftree8 *low = create_tree8(bs);
-        hufftree8 *high = create_tree8(bs);
-        if (!low || !high) {
-            free_tree8(low);
-            free_tree8(high);
-            return NULL;
-        }
-        return create_tree16(bs, low, high);
-    } else {
+    if (!read_bit(bs)) {
+        return NULL;
+    }
+    hufftree16 *tree = (hufftree16 *) clear_malloc(sizeof(hufftree16));
+    if (!tree) {
+        log_error("SMK: no memory for 16-bit tree", 0, 0);
         return NULL;
     }
+    // Both 8-bit trees are always read to keep the bitstream position
+    int has_low = read_tree8(bs, &tree->low);
+    int has_high = read_tree8(bs, &tree->high);
+    if (!has_low || !has_high || !read_tree16(bs, tree)) {
+        free_tree16(tree);
+        return NULL;
+    }
+    return tree;
 }
 
-static void read_header_trees(smacker s, uint8_t *data)
+static void read_header_trees(smacker s, const uint8_t *data)
 {
     bitstream bstream;
     bitstream *bs = bitstream_init(&bstream, data, s->trees_size);
@@ -396,10 +516,20 @@ static void read_header_trees(smacker s, uint8_t *data)
 
 // Smacker I/O functions
 
+static const uint8_t *read_from_file(smacker s, int length)
+{
+    if (length < 0 || length > s->file.size - s->file_offset) {
+        return NULL;
+    }
+    const uint8_t *data = &s->file.data[s->file_offset];
+    s->file_offset += length;
+    return data;
+}
+
 static int read_header(smacker s)
 {
-    uint8_t header[HEADER_SIZE];
-    if (fread(header, 1, HEADER_SIZE, s->fp) != HEADER_SIZE) {
+    const uint8_t *header = read_from_file(s, HEADER_SIZE);
+    if (!header) {
         log_error("SMK: unable to read header", 0, 0);
         return 0;
     }
@@ -440,7 +570,7 @@ static int read_frame_info(smacker s)
     int types_length = sizeof(uint8_t) * s->frames;
 
     s->frame_sizes = (int32_t *) clear_malloc(sizes_length);
-    s->frame_offsets = (long *) clear_malloc(sizeof(long) * s->frames);
+    s->frame_offsets = (int *) clear_malloc(sizeof(int) * s->frames);
     s->frame_types = (uint8_t *) clear_malloc(types_length);
 
     if (!s->frame_sizes || !s->frame_offsets || !s->frame_types) {
@@ -451,19 +581,20 @@ static int read_frame_info(smacker s)
         return 0;
     }
 
-    if (fread(s->frame_sizes, 1, sizes_length, s->fp) != (unsigned) sizes_length ||
-        fread(s->frame_types, 1, types_length, s->fp) != (unsigned) types_length) {
+    const uint8_t *data = read_from_file(s, sizes_length);
+    const uint8_t *types = read_from_file(s, types_length);
+    if (!data || !types) {
         log_error("SMK: unable to read frame info from file", 0, 0);
         free(s->frame_sizes);
         free(s->frame_offsets);
         free(s->frame_types);
         return 0;
     }
+    memcpy(s->frame_types, types, types_length);
 
-    uint8_t *data = (uint8_t *) s->frame_sizes;
-    long offset = 0;
+    int offset = 0;
     for (int i = 0; i < s->frames; i++) {
-        // Clear first two flag bits in-place (and flip endian-ness if necessary)
+        // Clear first two flag bits (and flip endian-ness if necessary)
         s->frame_sizes[i] = read_i32(&data[4 * i]) & 0xfffffffc;
         s->frame_offsets[i] = offset;
         offset += s->frame_sizes[i];
@@ -473,32 +604,26 @@ static int read_frame_info(smacker s)
 
 static int read_trees_data(smacker s)
 {
-    uint8_t *trees_data = (uint8_t *) clear_malloc(s->trees_size);
+    const uint8_t *trees_data = read_from_file(s, s->trees_size);
     if (!trees_data) {
-        log_error("SMK: no memory for tree input data", 0, 0);
-        return 0;
-    }
-    if (fread(trees_data, 1, s->trees_size, s->fp) != (unsigned) s->trees_size) {
         log_error("SMK: unable to read tree data from file", 0, 0);
-        free(trees_data);
         return 0;
     }
     read_header_trees(s, trees_data);
-    free(trees_data);
     return 1;
 }
 
-static int allocate_frame_memory(smacker s)
+static int allocate_frame_memory(smacker s, frame_data_t *frame)
 {
-    s->frame_data.video = clear_malloc(sizeof(uint8_t) * s->width * s->height);
-    if (!s->frame_data.video) {
+    frame->video = clear_malloc(sizeof(uint8_t) * s->width * s->height);
+    if (!frame->video) {
         log_error("SMK: no memory for video frame", 0, 0);
         return 0;
     }
     for (int i = 0; i < MAX_TRACKS; i++) {
         if (s->audio_rate[i] & AUDIO_FLAG_HAS_TRACK) {
-            s->frame_data.audio[i] = clear_malloc(s->audio_size[i]);
-            if (!s->frame_data.audio[i]) {
+            frame->audio[i] = clear_malloc(s->audio_size[i]);
+            if (!frame->audio[i]) {
                 log_error("SMK: no memory for audio track", 0, i);
                 return 0;
             }
@@ -507,15 +632,28 @@ static int allocate_frame_memory(smacker s)
     return 1;
 }
 
-smacker smacker_open(FILE *fp)
+static void free_frame_memory(frame_data_t *frame)
 {
-    if (!fp) {
-        log_error("SMK: file does not exist", 0, 0);
-        return NULL;
+    for (int i = 0; i < MAX_TRACKS; i++) {
+        free(frame->audio[i]);
+        frame->audio[i] = 0;
     }
+    free(frame->video);
+    frame->video = 0;
+}
+
+smacker smacker_open(const char *filename)
+{
     smacker s = (struct smacker_t *) clear_malloc(sizeof(struct smacker_t));
-    memset(s, 0, sizeof(struct smacker_t));
-    s->fp = fp;
+    if (!s) {
+        log_error("SMK: no memory for video", 0, 0);
+        return NULL;
+    }
+    if (!io_map_file(filename, &s->file)) {
+        log_error("SMK: file does not exist", filename, 0);
+        free(s);
+        return NULL;
+    }
 
     if (!read_header(s)) {
         smacker_close(s);
@@ -529,17 +667,21 @@ smacker smacker_open(FILE *fp)
         smacker_close(s);
         return NULL;
     }
-    if (!allocate_frame_memory(s)) {
+    if (!allocate_frame_memory(s, &s->frame_data)) {
         smacker_close(s);
         return NULL;
     }
-    s->frame_data_offset_in_file = ftell(s->fp);
+    s->frame_data_offset_in_file = s->file_offset;
+    s->current = &s->frame_data;
     return s;
 }
 
+static void stop_decoder(smacker s);
+
 void smacker_close(smacker s)
 {
-    file_close(s->fp);
+    stop_decoder(s);
+    io_unmap_file(&s->file);
     free(s->frame_offsets);
     free(s->frame_sizes);
     free(s->frame_types);
@@ -547,10 +689,10 @@ void smacker_close(smacker s)
     free_tree16(s->mmap_tree);
     free_tree16(s->full_tree);
     free_tree16(s->type_tree);
-    for (int i = 0; i < MAX_TRACKS; i++) {
-        free(s->frame_data.audio[i]);
+    for (int i = 0; i < 4; i++) {
+        free_tree(&s->audio_trees[i]);
     }
-    free(s->frame_data.video);
+    free_frame_memory(&s->frame_data);
     free(s);
 }
 
@@ -612,21 +754,17 @@ void smacker_get_audio_info(const smacker s, int track, int *enabled, int *chann
 
 // Smacker decoding functions
 
-static int read_audio_frame_trees(bitstream *bs, hufftree8 **trees, int num_trees)
+static int read_audio_frame_trees(bitstream *bs, hufftree *trees, int num_trees)
 {
     for (int i = 0; i < num_trees; i++) {
-        trees[i] = create_tree8(bs);
-        if (!trees[i]) {
-            for (int j = 0; j < i; j++) {
-                free_tree8(trees[j]);
-            }
+        if (!read_tree8(bs, &trees[i])) {
             return 0;
         }
     }
     return 1;
 }
 
-static int decode_audio_track(smacker s, int track, uint8_t *data, int length)
+static int decode_audio_track(smacker s, int track, const uint8_t *data, int length)
 {
     if ((s->audio_rate[track] & AUDIO_FLAG_COMPRESSED) == 0) {
         // Uncompressed data, just copy and return
@@ -660,7 +798,7 @@ static int decode_audio_track(smacker s, int track, uint8_t *data, int length)
     int channels = is_stereo ? 2 : 1;
     int rate_bytes = is_16bit ? 2 : 1;
     int num_trees = channels * rate_bytes;
-    hufftree8 *trees[4];
+    hufftree *trees = s->audio_trees;
     if (!read_audio_frame_trees(bs, trees, num_trees)) {
         log_error("SMK: unable to read audio huffman trees", 0, 0);
         return 0;
@@ -678,8 +816,8 @@ static int decode_audio_track(smacker s, int track, uint8_t *data, int length)
         while (index < uncompressed_length / 2) {
             for (int c = 0; c < channels; c++) {
                 // Do not join the following two lines as it results in an optimization bug for MSVC. See PR #215
-                uint16_t value = lookup_tree8(bs, trees[c * 2]);
-                value |= lookup_tree8(bs, trees[c * 2 + 1]) << 8;
+                uint16_t value = lookup_tree8(bs, &trees[c * 2]);
+                value |= lookup_tree8(bs, &trees[c * 2 + 1]) << 8;
                 audio_data[index] = value + audio_data[index - channels];
                 index++;
             }
@@ -696,7 +834,7 @@ static int decode_audio_track(smacker s, int track, uint8_t *data, int length)
 
         while (index < uncompressed_length) {
             for (int c = 0; c < channels; c++) {
-                audio_data[index] = lookup_tree8(bs, trees[c]) + audio_data[index - channels];
+                audio_data[index] = lookup_tree8(bs, &trees[c]) + audio_data[index - channels];
                 index++;
             }
         }
@@ -705,7 +843,7 @@ static int decode_audio_track(smacker s, int track, uint8_t *data, int length)
     return 1;
 }
 
-static int decode_palette(smacker s, uint8_t *data, int length)
+static int decode_palette(smacker s, const uint8_t *data, int length)
 {
     color_t new_palette[MAX_PALETTE];
     int index = 0;
@@ -746,7 +884,7 @@ static int decode_palette(smacker s, uint8_t *data, int length)
     return 1;
 }
 
-static int decode_video(smacker s, uint8_t *frame_data, int length)
+static int decode_video(smacker s, const uint8_t *frame_data, int length)
 {
     reset_escape16(s->mclr_tree);
     reset_escape16(s->mmap_tree);
@@ -804,31 +942,16 @@ static int decode_video(smacker s, uint8_t *frame_data, int length)
     return 1;
 }
 
-static uint8_t *read_frame_data(smacker s, int frame_id)
+static const uint8_t *read_frame_data(smacker s, int frame_id)
 {
-    if (fseek(s->fp, s->frame_data_offset_in_file + s->frame_offsets[frame_id], SEEK_SET) != 0) {
-        log_error("SMK: unable to seek to frame data", 0, frame_id);
-        return NULL;
-    }
-    int frame_size = s->frame_sizes[frame_id];
-    uint8_t *frame_data = (uint8_t *) clear_malloc(frame_size);
+    s->file_offset = s->frame_data_offset_in_file + s->frame_offsets[frame_id];
+    const uint8_t *frame_data = read_from_file(s, s->frame_sizes[frame_id]);
     if (!frame_data) {
-        log_error("SMK: no memory for frame data", 0, frame_id);
-        return NULL;
-    }
-    if (fread(frame_data, 1, frame_size, s->fp) != (unsigned) frame_size) {
         log_error("SMK: unable to read data for frame", 0, frame_id);
-        free(frame_data);
-        return NULL;
     }
     return frame_data;
 }
 
-static void free_frame_data(__attribute__((unused)) const smacker s, uint8_t *frame_data)
-{
-    free(frame_data);
-}
-
 static smacker_frame_status decode_frame(smacker s)
 {
     int frame_id = s->current_frame;
@@ -836,7 +959,7 @@ static smacker_frame_status decode_frame(smacker s)
         return SMACKER_FRAME_DONE;
     }
 
-    uint8_t *frame_data = read_frame_data(s, frame_id);
+    const uint8_t *frame_data = read_frame_data(s, frame_id);
     if (!frame_data) {
         return SMACKER_FRAME_ERROR;
     }
@@ -846,7 +969,6 @@ static smacker_frame_status decode_frame(smacker s)
     if (frame_type & 0x01) {
         int palette_size = frame_data[0] * 4;
         if (!decode_palette(s, &frame_data[1], palette_size - 1)) {
-            free_frame_data(s, frame_data);
             return SMACKER_FRAME_ERROR;
         }
         data_index += palette_size;
@@ -861,22 +983,146 @@ static smacker_frame_status decode_frame(smacker s)
         }
     }
     if (!decode_video(s, &frame_data[data_index], s->frame_sizes[frame_id] - data_index)) {
-        free_frame_data(s, frame_data);
         return SMACKER_FRAME_ERROR;
     }
 
-    free_frame_data(s, frame_data);
     return SMACKER_FRAME_OK;
 }
 
+// Background decoder
+
+static void copy_frame(smacker s, const frame_data_t *src, frame_data_t *dst)
+{
+    memcpy(dst->palette, src->palette, sizeof(src->palette));
+    memcpy(dst->video, src->video, sizeof(uint8_t) * s->width * s->height);
+    for (int i = 0; i < MAX_TRACKS; i++) {
+        dst->audio_len[i] = src->audio_len[i];
+        if (src->audio_len[i] > 0) {
+            memcpy(dst->audio[i], src->audio[i], src->audio_len[i]);
+        }
+    }
+}
+
+static int decoder_loop(void *userdata)
+{
+    smacker s = (smacker) userdata;
+    smacker_frame_status status = SMACKER_FRAME_OK;
+    while (status == SMACKER_FRAME_OK) {
+        platform_mutex_lock(s->queue.mutex);
+        while (s->queue.count == FRAME_QUEUE_SIZE && !s->queue.quit) {
+            platform_condition_wait(s->queue.slot_free, s->queue.mutex);
+        }
+        int slot = (s->queue.head + s->queue.count) % FRAME_QUEUE_SIZE;
+        int quit = s->queue.quit;
+        platform_mutex_unlock(s->queue.mutex);
+        if (quit) {
+            break;
+        }
+
+        // The decoder keeps its own frame because frames only store the changes to the previous one
+        s->current_frame++;
+        status = decode_frame(s);
+        if (status == SMACKER_FRAME_OK) {
+            copy_frame(s, &s->frame_data, &s->queue.frames[slot]);
+        }
+
+        platform_mutex_lock(s->queue.mutex);
+        s->queue.status[slot] = status;
+        s->queue.count++;
+        platform_condition_signal(s->queue.frame_ready);
+        platform_mutex_unlock(s->queue.mutex);
+    }
+    return 0;
+}
+
+static void free_decoder(smacker s)
+{
+    platform_condition_destroy(s->queue.frame_ready);
+    platform_condition_destroy(s->queue.slot_free);
+    platform_mutex_destroy(s->queue.mutex);
+    for (int i = 0; i < FRAME_QUEUE_SIZE; i++) {
+        free_frame_memory(&s->queue.frames[i]);
+    }
+    memset(&s->queue, 0, sizeof(s->queue));
+    s->current = &s->frame_data;
+}
+
+static void stop_decoder(smacker s)
+{
+    if (s->queue.thread) {
+        platform_mutex_lock(s->queue.mutex);
+        s->queue.quit = 1;
+        platform_condition_signal(s->queue.slot_free);
+        platform_mutex_unlock(s->queue.mutex);
+        platform_thread_wait(s->queue.thread);
+    }
+    free_decoder(s);
+}
+
+int smacker_start_decoder(smacker s)
+{
+    if (s->queue.thread) {
+        return 1;
+    }
+    s->queue.mutex = platform_mutex_create();
+    s->queue.frame_ready = platform_condition_create();
+    s->queue.slot_free = platform_condition_create();
+    if (!s->queue.mutex || !s->queue.frame_ready || !s->queue.slot_free) {
+        free_decoder(s);
+        return 0;
+    }
+    for (int i = 0; i < FRAME_QUEUE_SIZE; i++) {
+        if (!allocate_frame_memory(s, &s->queue.frames[i])) {
+            free_decoder(s);
+            return 0;
+        }
+    }
+    // The current frame is the first one in the queue
+    copy_frame(s, &s->frame_data, &s->queue.frames[0]);
+    s->queue.status[0] = SMACKER_FRAME_OK;
+    s->queue.head = 0;
+    s->queue.count = 1;
+    s->current = &s->queue.frames[0];
+
+    s->queue.thread = platform_thread_create(decoder_loop, "smacker", s);
+    if (!s->queue.thread) {
+        free_decoder(s);
+        return 0;
+    }
+    return 1;
+}
+
+static smacker_frame_status next_queued_frame(smacker s)
+{
+    platform_mutex_lock(s->queue.mutex);
+    smacker_frame_status status = s->queue.status[s->queue.head];
+    if (status == SMACKER_FRAME_OK) {
+        // Release the current frame to the decoder and wait for the next one
+        s->queue.head = (s->queue.head + 1) % FRAME_QUEUE_SIZE;
+        s->queue.count--;
+        platform_condition_signal(s->queue.slot_free);
+        while (s->queue.count == 0) {
+            platform_condition_wait(s->queue.frame_ready, s->queue.mutex);
+        }
+        status = s->queue.status[s->queue.head];
+        s->current = &s->queue.frames[s->queue.head];
+    }
+    platform_mutex_unlock(s->queue.mutex);
+    return status;
+}
+
 smacker_frame_status smacker_first_frame(smacker s)
 {
+    stop_decoder(s);
     s->current_frame = 0;
     return decode_frame(s);
 }
 
 smacker_frame_status smacker_next_frame(smacker s)
 {
+    if (s->queue.thread) {
+        return next_queued_frame(s);
+    }
     s->current_frame++;
     return decode_frame(s);
 }
@@ -885,20 +1131,20 @@ smacker_frame_status smacker_next_frame(smacker s)
 
 const uint32_t *smacker_get_frame_palette(const smacker s)
 {
-    return s->frame_data.palette;
+    return s->current->palette;
 }
 
 const uint8_t *smacker_get_frame_video(const smacker s)
 {
-    return s->frame_data.video;
+    return s->current->video;
 }
 
 int smacker_get_frame_audio_size(const smacker s, int track)
 {
-    return s->frame_data.audio_len[track];
+    return s->current->audio_len[track];
 }
 
 const uint8_t *smacker_get_frame_audio(const smacker s, int track)
 {
-    return s->frame_data.audio[track];
+    return s->current->audio[track];
 }
@@ -3,7 +3,6 @@
 
 #include "graphics/color.h"
 
-#include <stdio.h>
 #include <stdint.h>
 
 /** Smacker object struct pointer */
@@ -27,7 +26,7 @@ typedef enum {
  * @param file File
  * @return Smacker object if opening succeeded, otherwise NULL
  */
-smacker smacker_open(FILE *file);
+smacker smacker_open(const char *filename);
 
 /**
  * Close SMK file and clean up memory
@@ -70,6 +69,15 @@ void smacker_get_audio_info(const smacker s, int track, int *enabled, int *chann
  */
 smacker_frame_status smacker_first_frame(smacker s);
 
+/**
+ * Start decoding the following frames ahead on a background thread.
+ * Must be called after smacker_first_frame(); frames are then taken from
+ * a small queue by smacker_next_frame() without decoding them.
+ * @param s Smacker object
+ * @return 1 if the decoder was started, 0 if frames are decoded on demand
+ */
+int smacker_start_decoder(smacker s);
+
 /**
  * Go to next frame and unpack
  * @param s Smacker object
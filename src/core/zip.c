@@ -16,6 +16,11 @@ enum {
     PK_EOF = 773,
 };
 
+#define PK_INPUT_BUFFER_SIZE 8708
+#define PK_MAX_COPY_LENGTH 516
+#define PK_HASH_BITS 12
+#define PK_HASH_SIZE (1 << PK_HASH_BITS)
+
 struct pk_token {
     int stop;
 
@@ -41,36 +46,34 @@ struct pk_comp_buffer {
     unsigned int copy_offset_extra_mask;
     int current_output_bits_used;
 
-    uint8_t input_data[8708];
+    int chain_depth; // 0 = exhaustive search
+    int nice_length;
+    int lazy_matching;
+    int data_start;
+    int chain_next;
+
+    uint8_t input_data[PK_INPUT_BUFFER_SIZE];
     uint8_t output_data[2050];
     int output_ptr;
 
     uint16_t analyze_offset_table[2304];
-    uint16_t analyze_index[8708];
+    uint16_t analyze_index[PK_INPUT_BUFFER_SIZE];
     signed short long_matcher[518];
 
+    int16_t hash_head[PK_HASH_SIZE];
+    int16_t hash_prev[PK_INPUT_BUFFER_SIZE];
+
     uint16_t codeword_values[774];
     uint8_t codeword_bits[774];
 };
 
-struct pk_decomp_buffer {
-    pk_input_func *input_func;
-    pk_output_func *output_func;
-    struct pk_token *token;
-
-    int window_size;
-    int dictionary_size;
-    uint16_t current_input_byte;
-    int current_input_bits_available;
-
-    int input_buffer_ptr;
-    int input_buffer_end;
-    int output_buffer_ptr;
-    uint8_t input_buffer[2048];
-    uint8_t output_buffer[8708]; // 2x 4096 (max dict size) + 516 for copying
-
-    uint8_t copy_offset_jump_table[256];
-    uint8_t copy_length_jump_table[256];
+struct pk_bit_reader {
+    const uint8_t *data;
+    int length;
+    int position;
+    uint64_t bits;
+    int bits_available;
+    int padding_bits;
 };
 
 struct pk_copy_length_offset {
@@ -114,6 +117,46 @@ static const uint8_t pk_copy_length_extra_bits[16] = {
     0, 0, 0, 0, 0, 0, 0, 0, 1, 2, 3, 4, 5, 6, 7, 8,
 };
 
+// Copy length index for the next 8 input bits
+static const uint8_t pk_copy_length_lookup[256] = {
+    15, 2, 5, 1, 8, 0, 3, 1, 10, 2, 4, 1, 6, 0, 3, 1,
+    12, 2, 5, 1, 7, 0, 3, 1, 9, 2, 4, 1, 6, 0, 3, 1,
+    13, 2, 5, 1, 8, 0, 3, 1, 10, 2, 4, 1, 6, 0, 3, 1,
+    11, 2, 5, 1, 7, 0, 3, 1, 9, 2, 4, 1, 6, 0, 3, 1,
+    14, 2, 5, 1, 8, 0, 3, 1, 10, 2, 4, 1, 6, 0, 3, 1,
+    12, 2, 5, 1, 7, 0, 3, 1, 9, 2, 4, 1, 6, 0, 3, 1,
+    13, 2, 5, 1, 8, 0, 3, 1, 10, 2, 4, 1, 6, 0, 3, 1,
+    11, 2, 5, 1, 7, 0, 3, 1, 9, 2, 4, 1, 6, 0, 3, 1,
+    15, 2, 5, 1, 8, 0, 3, 1, 10, 2, 4, 1, 6, 0, 3, 1,
+    12, 2, 5, 1, 7, 0, 3, 1, 9, 2, 4, 1, 6, 0, 3, 1,
+    13, 2, 5, 1, 8, 0, 3, 1, 10, 2, 4, 1, 6, 0, 3, 1,
+    11, 2, 5, 1, 7, 0, 3, 1, 9, 2, 4, 1, 6, 0, 3, 1,
+    14, 2, 5, 1, 8, 0, 3, 1, 10, 2, 4, 1, 6, 0, 3, 1,
+    12, 2, 5, 1, 7, 0, 3, 1, 9, 2, 4, 1, 6, 0, 3, 1,
+    13, 2, 5, 1, 8, 0, 3, 1, 10, 2, 4, 1, 6, 0, 3, 1,
+    11, 2, 5, 1, 7, 0, 3, 1, 9, 2, 4, 1, 6, 0, 3, 1,
+};
+
+// Copy offset index for the next 8 input bits
+static const uint8_t pk_copy_offset_lookup[256] = {
+    63, 6, 23, 0, 39, 2, 14, 0, 47, 4, 18, 0, 31, 1, 10, 0,
+    55, 5, 20, 0, 35, 2, 12, 0, 43, 3, 16, 0, 27, 1, 8, 0,
+    59, 6, 21, 0, 37, 2, 13, 0, 45, 4, 17, 0, 29, 1, 9, 0,
+    51, 5, 19, 0, 33, 2, 11, 0, 41, 3, 15, 0, 25, 1, 7, 0,
+    61, 6, 22, 0, 38, 2, 14, 0, 46, 4, 18, 0, 30, 1, 10, 0,
+    53, 5, 20, 0, 34, 2, 12, 0, 42, 3, 16, 0, 26, 1, 8, 0,
+    57, 6, 21, 0, 36, 2, 13, 0, 44, 4, 17, 0, 28, 1, 9, 0,
+    49, 5, 19, 0, 32, 2, 11, 0, 40, 3, 15, 0, 24, 1, 7, 0,
+    62, 6, 23, 0, 39, 2, 14, 0, 47, 4, 18, 0, 31, 1, 10, 0,
+    54, 5, 20, 0, 35, 2, 12, 0, 43, 3, 16, 0, 27, 1, 8, 0,
+    58, 6, 21, 0, 37, 2, 13, 0, 45, 4, 17, 0, 29, 1, 9, 0,
+    50, 5, 19, 0, 33, 2, 11, 0, 41, 3, 15, 0, 25, 1, 7, 0,
+    60, 6, 22, 0, 38, 2, 14, 0, 46, 4, 18, 0, 30, 1, 10, 0,
+    52, 5, 20, 0, 34, 2, 12, 0, 42, 3, 16, 0, 26, 1, 8, 0,
+    56, 6, 21, 0, 36, 2, 13, 0, 44, 4, 17, 0, 28, 1, 9, 0,
+    48, 5, 19, 0, 32, 2, 11, 0, 40, 3, 15, 0, 24, 1, 7, 0,
+};
+
 static void pk_memcpy(uint8_t *dst, const uint8_t *src, int length)
 {
     for (int i = 0; i < length; i++) {
@@ -342,11 +385,92 @@ static void pk_implode_determine_copy(struct pk_comp_buffer *buf, int input_inde
     // never reached
 }
 
+static int pk_implode_hash(const uint8_t *data)
+{
+    uint32_t value = (uint32_t) (data[0] << 16 | data[1] << 8 | data[2]);
+    return (int) ((value * 2654435761u) >> (32 - PK_HASH_BITS));
+}
+
+static void pk_implode_reset_chains(struct pk_comp_buffer *buf, int start)
+{
+    memset(buf->hash_head, 0xff, sizeof(buf->hash_head));
+    buf->chain_next = start;
+}
+
+static int pk_implode_match_length(const uint8_t *a, const uint8_t *b, int max_length)
+{
+    int length = 0;
+    // Compare eight bytes at a time before falling back to single bytes
+    while (length + 8 <= max_length) {
+        uint64_t a_word, b_word;
+        memcpy(&a_word, &a[length], 8);
+        memcpy(&b_word, &b[length], 8);
+        if (a_word != b_word) {
+            break;
+        }
+        length += 8;
+    }
+    while (length < max_length && a[length] == b[length]) {
+        length++;
+    }
+    return length;
+}
+
+static void pk_implode_find_chained_copy(struct pk_comp_buffer *buf, int input_index,
+                                         struct pk_copy_length_offset *copy)
+{
+    while (buf->chain_next < input_index) {
+        int position = buf->chain_next++;
+        int hash_value = pk_implode_hash(&buf->input_data[position]);
+        buf->hash_prev[position] = buf->hash_head[hash_value];
+        buf->hash_head[hash_value] = (int16_t) position;
+    }
+    copy->length = 0;
+    copy->offset = 0;
+
+    int max_length = PK_INPUT_BUFFER_SIZE - input_index;
+    if (max_length > PK_MAX_COPY_LENGTH) {
+        max_length = PK_MAX_COPY_LENGTH;
+    }
+    if (max_length < 3) {
+        return;
+    }
+    const uint8_t *input_ptr = &buf->input_data[input_index];
+    int min_match_index = input_index - buf->dictionary_size + 1;
+    int best_length = 2; // 2-byte copies rarely pay off, only look for longer ones
+    int chain_left = buf->chain_depth;
+    int match_index = buf->hash_head[pk_implode_hash(input_ptr)];
+    while (match_index >= min_match_index && chain_left-- > 0) {
+        const uint8_t *match_ptr = &buf->input_data[match_index];
+        if (match_ptr[best_length] == input_ptr[best_length]) {
+            int length = pk_implode_match_length(match_ptr, input_ptr, max_length);
+            if (length > best_length) {
+                best_length = length;
+                copy->length = length;
+                copy->offset = (uint16_t) (input_index - match_index - 1);
+                if (length >= buf->nice_length || length == max_length) {
+                    break;
+                }
+            }
+        }
+        match_index = buf->hash_prev[match_index];
+    }
+}
+
+static void pk_implode_find_copy(struct pk_comp_buffer *buf, int input_index, struct pk_copy_length_offset *copy)
+{
+    if (buf->chain_depth) {
+        pk_implode_find_chained_copy(buf, input_index, copy);
+    } else {
+        pk_implode_determine_copy(buf, input_index, copy);
+    }
+}
+
 static int pk_implode_next_copy_is_better(
     struct pk_comp_buffer *buf, int offset, const struct pk_copy_length_offset *current_copy)
 {
     struct pk_copy_length_offset next_copy;
-    pk_implode_determine_copy(buf, offset + 1, &next_copy);
+    pk_implode_find_copy(buf, offset + 1, &next_copy);
     if (current_copy->length >= next_copy.length) {
         return 0;
     }
@@ -388,6 +512,11 @@ static void pk_implode_data(struct pk_comp_buffer *buf)
     int input_ptr = buf->dictionary_size + 516;
     pk_memset(&buf->output_data[2], 0, 2048);
 
+    buf->data_start = input_ptr;
+    if (buf->chain_depth) {
+        pk_implode_reset_chains(buf, input_ptr);
+    }
+
     buf->current_output_bits_used = 0;
 
     while (!eof) {
@@ -403,7 +532,10 @@ static void pk_implode_data(struct pk_comp_buffer *buf)
             input_end += 516; // eat the 516 leftovers anyway
         }
 
-        if (has_leftover_data == 0) {
+        if (buf->chain_depth) {
+            // Hash chains are built while matching
+            has_leftover_data = 1;
+        } else if (has_leftover_data == 0) {
             pk_implode_analyze_input(buf, input_ptr, input_end + 1);
             has_leftover_data++;
             if (buf->dictionary_size != 4096) {
@@ -420,7 +552,7 @@ static void pk_implode_data(struct pk_comp_buffer *buf)
             int write_literal = 0;
             int write_copy = 0;
             struct pk_copy_length_offset copy;
-            pk_implode_determine_copy(buf, input_ptr, &copy);
+            pk_implode_find_copy(buf, input_ptr, &copy);
 
             if (copy.length == 0) {
                 write_literal = 1;
@@ -435,7 +567,7 @@ static void pk_implode_data(struct pk_comp_buffer *buf)
                 }
             } else if (copy.length >= 8 || input_ptr + 1 >= input_end) {
                 write_copy = 1;
-            } else if (pk_implode_next_copy_is_better(buf, input_ptr, &copy)) {
+            } else if (buf->lazy_matching && pk_implode_next_copy_is_better(buf, input_ptr, &copy)) {
                 write_literal = 1;
             } else {
                 write_copy = 1;
@@ -455,6 +587,11 @@ static void pk_implode_data(struct pk_comp_buffer *buf)
         if (!eof) {
             input_ptr -= 4096;
             pk_memcpy(buf->input_data, &buf->input_data[4096], buf->dictionary_size + 516);
+            buf->data_start = buf->data_start > 4096 ? buf->data_start - 4096 : 0;
+            if (buf->chain_depth) {
+                int chain_start = input_ptr - buf->dictionary_size + 1;
+                pk_implode_reset_chains(buf, chain_start > buf->data_start ? chain_start : buf->data_start);
+            }
         }
     }
 
@@ -466,8 +603,30 @@ static void pk_implode_data(struct pk_comp_buffer *buf)
     buf->output_func(buf->output_data, buf->output_ptr, buf->token);
 }
 
+static void pk_implode_set_level(struct pk_comp_buffer *buf, zip_compression_level level)
+{
+    switch (level) {
+        case ZIP_COMPRESSION_FASTEST:
+            buf->chain_depth = 4;
+            buf->nice_length = 16;
+            buf->lazy_matching = 0;
+            break;
+        case ZIP_COMPRESSION_FAST:
+            buf->chain_depth = 32;
+            buf->nice_length = 128;
+            buf->lazy_matching = 1;
+            break;
+        default:
+            buf->chain_depth = 0;
+            buf->nice_length = PK_MAX_COPY_LENGTH;
+            buf->lazy_matching = 1;
+            break;
+    }
+}
+
 static int pk_implode(pk_input_func *input_func, pk_output_func *output_func,
-                      struct pk_comp_buffer *buf, struct pk_token *token, int dictionary_size)
+                      struct pk_comp_buffer *buf, struct pk_token *token, int dictionary_size,
+                      zip_compression_level level)
 {
     buf->input_func = input_func;
     buf->output_func = output_func;
@@ -485,6 +644,7 @@ static int pk_implode(pk_input_func *input_func, pk_output_func *output_func,
     } else {
         return PK_INVALID_WINDOWSIZE;
     }
+    pk_implode_set_level(buf, level);
 
     for (int i = 0; i < 256; i++) {
         buf->codeword_bits[i] = 9; // 8 + 1 for leading zero
@@ -509,178 +669,130 @@ static int pk_implode(pk_input_func *input_func, pk_output_func *output_func,
     return PK_SUCCESS;
 }
 
-static void pk_explode_construct_jump_table(int size, const uint8_t *bits, const uint8_t *codes, uint8_t *jump)
+static void pk_explode_refill(struct pk_bit_reader *reader)
 {
-    for (int i = size - 1; i >= 0; i--) {
-        uint8_t bit = bits[i];
-        int code = codes[i];
-        do {
-            jump[code] = (uint8_t) i;
-            code += 1 << bit;
-        } while (code < 0x100);
+    while (reader->bits_available <= 56) {
+        uint64_t value = 0;
+        if (reader->position < reader->length) {
+            value = reader->data[reader->position++];
+        } else {
+            reader->padding_bits += 8;
+        }
+        reader->bits |= value << reader->bits_available;
+        reader->bits_available += 8;
     }
 }
 
-static int pk_explode_set_bits_used(struct pk_decomp_buffer *buf, int num_bits)
+static void pk_explode_consume(struct pk_bit_reader *reader, int num_bits)
 {
-    if (buf->current_input_bits_available >= num_bits) {
-        buf->current_input_bits_available -= num_bits;
-        buf->current_input_byte = (uint16_t) (buf->current_input_byte >> num_bits);
-        return 0;
-    }
-    buf->current_input_byte = (uint16_t) (buf->current_input_byte >> buf->current_input_bits_available);
-    if (buf->input_buffer_ptr == buf->input_buffer_end) {
-        // Fill buffer
-        buf->input_buffer_ptr = 2048;
-        buf->input_buffer_end = buf->input_func(buf->input_buffer, buf->input_buffer_ptr, buf->token);
-        if (!buf->input_buffer_end) {
-            return 1;
-        }
-        buf->input_buffer_ptr = 0;
-    }
+    reader->bits >>= num_bits;
+    reader->bits_available -= num_bits;
+}
 
-    buf->current_input_byte |= (uint16_t) (buf->input_buffer[buf->input_buffer_ptr++] << 8);
-    buf->current_input_byte = (uint16_t) (buf->current_input_byte >> (num_bits - buf->current_input_bits_available));
-    buf->current_input_bits_available += 8 - num_bits;
-    return 0;
+static int pk_explode_is_past_end(const struct pk_bit_reader *reader)
+{
+    return reader->bits_available < reader->padding_bits;
 }
 
-static int pk_explode_decode_next_token(struct pk_decomp_buffer *buf)
+static int pk_explode_data(struct pk_bit_reader *reader, int window_size,
+                           uint8_t *output, int output_length, int *output_ptr)
 {
-    if (buf->current_input_byte & 1) {
-        // copy
-        if (pk_explode_set_bits_used(buf, 1)) {
-            return PK_ERROR_VALUE;
+    unsigned int offset_mask = 0xFFFFu >> (16 - window_size);
+    int ptr = 0;
+    while (1) {
+        // The longest token is 30 bits
+        if (reader->bits_available < 32) {
+            pk_explode_refill(reader);
         }
-        int index = buf->copy_length_jump_table[buf->current_input_byte & 0xff];
-        if (pk_explode_set_bits_used(buf, pk_copy_length_base_bits[index])) {
-            return PK_ERROR_VALUE;
+        if ((reader->bits & 1) == 0) {
+            // literal byte
+            uint8_t value = (uint8_t) (reader->bits >> 1);
+            pk_explode_consume(reader, 9);
+            if (pk_explode_is_past_end(reader)) {
+                return PK_ERROR_DECODING;
+            }
+            if (ptr >= output_length) {
+                log_error("COMP2 Out of buffer space.", 0, 0);
+                return PK_ERROR_DECODING;
+            }
+            output[ptr++] = value;
+            continue;
         }
+        pk_explode_consume(reader, 1);
+        int index = pk_copy_length_lookup[reader->bits & 0xff];
+        pk_explode_consume(reader, pk_copy_length_base_bits[index]);
         int extra_bits = pk_copy_length_extra_bits[index];
-        if (extra_bits) {
-            int extra_bits_value = buf->current_input_byte & ((1 << extra_bits) - 1);
-            if (pk_explode_set_bits_used(buf, extra_bits) && index + extra_bits_value != 270) {
-                return PK_ERROR_VALUE;
+        int length = pk_copy_length_base_value[index] + (int) (reader->bits & ((1u << extra_bits) - 1));
+        pk_explode_consume(reader, extra_bits);
+        if (length + 256 == PK_EOF) {
+            if (pk_explode_is_past_end(reader)) {
+                return PK_ERROR_DECODING;
             }
-            index = pk_copy_length_base_value[index] + extra_bits_value;
-        }
-        return index + 256;
-    } else {
-        // literal token
-        if (pk_explode_set_bits_used(buf, 1)) {
-            return PK_ERROR_VALUE;
+            *output_ptr = ptr;
+            return PK_SUCCESS;
         }
-        int result = buf->current_input_byte & 0xff;
-        if (pk_explode_set_bits_used(buf, 8)) {
-            return PK_ERROR_VALUE;
-        }
-        return result;
-    }
-}
-
-static int pk_explode_get_copy_offset(struct pk_decomp_buffer *buf, int copy_length)
-{
-    int index = buf->copy_offset_jump_table[buf->current_input_byte & 0xff];
-    if (pk_explode_set_bits_used(buf, pk_copy_offset_bits[index])) {
-        return 0;
-    }
-    int offset;
-    if (copy_length == 2) {
-        offset = (buf->current_input_byte & 3) | (index << 2);
-        if (pk_explode_set_bits_used(buf, 2)) {
-            return 0;
+        length += 2;
+
+        int offset_index = pk_copy_offset_lookup[reader->bits & 0xff];
+        pk_explode_consume(reader, pk_copy_offset_bits[offset_index]);
+        int distance;
+        if (length == 2) {
+            distance = ((offset_index << 2) | (int) (reader->bits & 3)) + 1;
+            pk_explode_consume(reader, 2);
+        } else {
+            distance = ((offset_index << window_size) | (int) (reader->bits & offset_mask)) + 1;
+            pk_explode_consume(reader, window_size);
         }
-    } else {
-        offset = (buf->current_input_byte & buf->dictionary_size) | (index << buf->window_size);
-        if (pk_explode_set_bits_used(buf, buf->window_size)) {
-            return 0;
+        if (pk_explode_is_past_end(reader)) {
+            return PK_ERROR_DECODING;
         }
-    }
-    return offset + 1;
-}
-
-static int pk_explode_data(struct pk_decomp_buffer *buf)
-{
-    int token;
-    buf->output_buffer_ptr = 4096;
-    while (1) {
-        token = pk_explode_decode_next_token(buf);
-        if (token >= PK_ERROR_VALUE - 1) {
-            break;
+        if (length > output_length - ptr) {
+            log_error("COMP2 Out of buffer space.", 0, 0);
+            return PK_ERROR_DECODING;
         }
-        if (token >= 256) {
-            // copy offset
-            int length = token - 254;
-            int offset = pk_explode_get_copy_offset(buf, length);
-            if (!offset) {
-                token = PK_ERROR_VALUE;
-                break;
+        uint8_t *dst = &output[ptr];
+        ptr += length;
+        if (distance > ptr - length) {
+            // The window before the start of the data is filled with zeros
+            int zeros = distance - (ptr - length);
+            if (zeros > length) {
+                zeros = length;
             }
-            uint8_t *src = &buf->output_buffer[buf->output_buffer_ptr - offset];
-            uint8_t *dst = &buf->output_buffer[buf->output_buffer_ptr];
-            buf->output_buffer_ptr += length;
-            do {
-                *dst = *src;
-                src++;
-                dst++;
-            } while (--length > 0);
-        } else {
-            // literal byte
-            buf->output_buffer[buf->output_buffer_ptr++] = (uint8_t) token;
+            memset(dst, 0, (size_t) zeros);
+            dst += zeros;
+            length -= zeros;
         }
-        if (buf->output_buffer_ptr >= 8192) {
-            // Flush buffer
-            buf->output_func(&buf->output_buffer[4096], 4096, buf->token);
-            pk_memcpy(buf->output_buffer, &buf->output_buffer[4096], buf->output_buffer_ptr - 4096);
-            buf->output_buffer_ptr -= 4096;
+        const uint8_t *src = dst - distance;
+        if (distance >= length) {
+            memcpy(dst, src, (size_t) length);
+        } else {
+            // Overlapping copy repeats the last bytes
+            for (int i = 0; i < length; i++) {
+                dst[i] = src[i];
+            }
         }
     }
-    int remaining_bytes = buf->output_buffer_ptr - 4096;
-    if (remaining_bytes > 0) {
-        // Flush buffer if needed
-        buf->output_func(&buf->output_buffer[4096], remaining_bytes, buf->token);
-    }
-    return token;
 }
 
-static int pk_explode(pk_input_func *input_func, pk_output_func *output_func,
-                      struct pk_decomp_buffer *buf, struct pk_token *token)
+static int pk_explode(const uint8_t *input, int input_length, uint8_t *output, int *output_length)
 {
-    buf->input_func = input_func;
-    buf->output_func = output_func;
-    buf->token = token;
-    buf->input_buffer_ptr = 2048;
-    int bytes_read = buf->input_func(buf->input_buffer, buf->input_buffer_ptr, buf->token);
-    buf->input_buffer_end = bytes_read;
-    if (bytes_read <= 4) {
+    if (input_length <= 4) {
         return PK_TOO_FEW_INPUT_BYTES;
     }
-    int has_literal_encoding = buf->input_buffer[0];
-    buf->window_size = buf->input_buffer[1];
-    buf->current_input_byte = buf->input_buffer[2];
-    buf->current_input_bits_available = 0;
-    buf->input_buffer_ptr = 3;
-
-    if (buf->window_size < 4 || buf->window_size > 6) {
+    int has_literal_encoding = input[0];
+    int window_size = input[1];
+    if (window_size < 4 || window_size > 6) {
         return PK_INVALID_WINDOWSIZE;
     }
-
-    buf->dictionary_size = 0xFFFF >> (16 - buf->window_size);
     if (has_literal_encoding) {
         return PK_LITERAL_ENCODING_UNSUPPORTED;
     }
-
-    // Decode data for copying bytes
-    pk_explode_construct_jump_table(16,
-        pk_copy_length_base_bits, pk_copy_length_base_code, buf->copy_length_jump_table);
-    pk_explode_construct_jump_table(64,
-        pk_copy_offset_bits, pk_copy_offset_code, buf->copy_offset_jump_table);
-
-    int result = pk_explode_data(buf);
-    if (result != PK_EOF) {
-        return PK_ERROR_DECODING;
-    }
-    return PK_SUCCESS;
+    struct pk_bit_reader reader;
+    memset(&reader, 0, sizeof(struct pk_bit_reader));
+    reader.data = input;
+    reader.length = input_length;
+    reader.position = 2;
+    return pk_explode_data(&reader, window_size, output, *output_length, output_length);
 }
 
 static int zip_input_func(uint8_t *buffer, int length, struct pk_token *token)
@@ -721,7 +833,7 @@ static void zip_output_func(uint8_t *buffer, int length, struct pk_token *token)
 }
 
 int zip_compress(const void *input_buffer, int input_length,
-                 void *output_buffer, int *output_length)
+                 void *output_buffer, int *output_length, zip_compression_level level)
 {
     struct pk_token token;
     struct pk_comp_buffer *buf = (struct pk_comp_buffer *) malloc(sizeof(struct pk_comp_buffer));
@@ -738,7 +850,7 @@ int zip_compress(const void *input_buffer, int input_length,
     token.output_length = *output_length;
 
     int ok = 1;
-    int pk_error = pk_implode(zip_input_func, zip_output_func, buf, &token, 4096);
+    int pk_error = pk_implode(zip_input_func, zip_output_func, buf, &token, 4096, level);
     if (pk_error || token.stop) {
         log_error("COMP Error occurred while compressing.", 0, 0);
         ok = 0;
@@ -752,26 +864,10 @@ int zip_compress(const void *input_buffer, int input_length,
 int zip_decompress(const void *input_buffer, int input_length,
                    void *output_buffer, int *output_length)
 {
-    struct pk_token token;
-    struct pk_decomp_buffer *buf = (struct pk_decomp_buffer *) malloc(sizeof(struct pk_decomp_buffer));
-    if (!buf) {
-        return 0;
-    }
-    memset(buf, 0, sizeof(struct pk_decomp_buffer));
-    memset(&token, 0, sizeof(struct pk_token));
-    token.input_data = (const uint8_t *) input_buffer;
-    token.input_length = input_length;
-    token.output_data = (uint8_t *) output_buffer;
-    token.output_length = *output_length;
-
-    int ok = 1;
-    int pk_error = pk_explode(zip_input_func, zip_output_func, buf, &token);
-    if (pk_error || token.stop) {
+    int pk_error = pk_explode((const uint8_t *) input_buffer, input_length, (uint8_t *) output_buffer, output_length);
+    if (pk_error) {
         log_error("COMP Error uncompressing.", 0, 0);
-        ok = 0;
-    } else {
-        *output_length = token.output_ptr;
+        return 0;
     }
-    free(buf);
-    return ok;
+    return 1;
 }
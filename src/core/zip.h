@@ -6,15 +6,26 @@
  * Compression functions.
  */
 
+/**
+ * Compression level: all levels produce data the original game can read
+ */
+typedef enum {
+    ZIP_COMPRESSION_FASTEST, /**< Short hash chains, no lazy matching */
+    ZIP_COMPRESSION_FAST, /**< Hash chains with lazy matching */
+    ZIP_COMPRESSION_BEST /**< Exhaustive search, identical output to the original game */
+} zip_compression_level;
+
 /**
  * Compresses the input buffer.
  * @param input_buffer Input buffer to compress
  * @param input_length Length of input buffer
  * @param output_buffer Output buffer to write the compressed data to
  * @param output_length IN: available length of the output buffer, OUT: written bytes
+ * @param level Compression level
  * @return boolean true on success, false on error
  */
-int zip_compress(const void *input_buffer, int input_length, void *output_buffer, int *output_length);
+int zip_compress(const void *input_buffer, int input_length, void *output_buffer, int *output_length,
+                 zip_compression_level level);
 
 /**
  * Decompresses the input buffer
@@ -77,6 +77,8 @@ static custom_string all_strings[] = {
     {TR_HOTKEY_BUILD_CLONE, "Clone building under cursor"},
     {TR_HOTKEY_LOAD_FILE, "Load file"},
     {TR_HOTKEY_SAVE_FILE, "Save file"},
+    {TR_HOTKEY_TAKE_SNAPSHOT, "Take snapshot"},
+    {TR_HOTKEY_RESTORE_SNAPSHOT, "Restore snapshot"},
     {TR_HOTKEY_DECREASE_GAME_SPEED, "Decrease game speed"},
     {TR_HOTKEY_INCREASE_GAME_SPEED, "Increase game speed"},
     {TR_HOTKEY_TOGGLE_PAUSE, "Toggle pause"},
@@ -52,6 +52,8 @@ typedef enum {
     TR_HOTKEY_BUILD_CLONE,
     TR_HOTKEY_LOAD_FILE,
     TR_HOTKEY_SAVE_FILE,
+    TR_HOTKEY_TAKE_SNAPSHOT,
+    TR_HOTKEY_RESTORE_SNAPSHOT,
     TR_HOTKEY_DECREASE_GAME_SPEED,
     TR_HOTKEY_INCREASE_GAME_SPEED,
     TR_HOTKEY_TOGGLE_PAUSE,
@@ -65,10 +65,18 @@
 #include "scenario/scenario.h"
 #include "sound/city.h"
 #include "sound/music.h"
+#include "window/city.h"
 
 #include <string.h>
 
 
+// Snapshots of the previous game must not be restored into the new one
+static void clear_snapshots(void)
+{
+    game_file_io_clear_snapshots();
+    window_city_reset_snapshot_restore();
+}
+
 static void clear_scenario_data(void)
 {
     // clear data
@@ -228,6 +236,7 @@ int game_file_start_scenario(const char *scenario)
     city_emperor_init_scenario();
     building_menu_update();
     city_message_init_scenario();
+    clear_snapshots();
     return 1;
 }
 
@@ -247,6 +256,19 @@ int game_file_load_saved_game(const char *dir, const char *filename)
     }
     initialize_saved_game();
     building_storage_reset_building_ids();
+    clear_snapshots();
+
+    sound_music_update(1);
+    return 1;
+}
+
+int game_file_restore_snapshot(int age)
+{
+    if (!game_file_io_restore_snapshot(age)) {
+        return 0;
+    }
+    initialize_saved_game();
+    building_storage_reset_building_ids();
 
     sound_music_update(1);
     return 1;
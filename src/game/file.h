@@ -24,4 +24,11 @@ int game_file_load_scenario_data(const char *scenario_file);
  */
 int game_file_load_saved_game(const char *dir, const char *filename);
 
+/**
+ * Restore the game from an in-memory snapshot
+ * @param age Snapshot to restore, 0 for the newest one
+ * @return Boolean true on success, false on failure
+ */
+int game_file_restore_snapshot(int age);
+
 #endif // GAME_FILE_H
@@ -7,11 +7,16 @@
 #include "city/culture.h"
 #include "city/data.h"
 #include "core/file.h"
+#include "core/io.h"
 #include "core/log.h"
 #include "city/message.h"
 #include "city/view.h"
+#include "core/calc.h"
+#include "core/config.h"
+#include "core/delta.h"
 #include "core/dir.h"
 #include "core/random.h"
+#include "core/string.h"
 #include "core/zip.h"
 #include "empire/empire.h"
 #include "empire/object.h"
@@ -22,6 +27,7 @@
 #include "figure/name.h"
 #include "figure/route.h"
 #include "figure/trader.h"
+#include "game/save_index.h"
 #include "game/time.h"
 #include "map/aqueduct.h"
 #include "map/bookmark.h"
@@ -36,6 +42,8 @@
 #include "map/sprite.h"
 #include "map/terrain.h"
 #include "platform/file_manager.h"
+#include "platform/platform.h"
+#include "platform/thread.h"
 #include "scenario/criteria.h"
 #include "scenario/earthquake.h"
 #include "scenario/emperor_change.h"
@@ -50,10 +58,20 @@
 
 #define COMPRESS_BUFFER_SIZE 600000
 #define UNCOMPRESSED 0x80000000
+#define MAX_SAVEGAME_PIECES 100
+// Pieces taking longer than this many microseconds to decode are logged
+#define PIECE_TIME_REPORT_THRESHOLD 2000
+#define MAX_SNAPSHOTS 1200
+#define MAX_SNAPSHOT_MEMORY_MB 1024
 
-static const int SAVE_GAME_VERSION = 0x66;
+// Offsets of the saved game summary fields within their pieces
+#define CITY_DATA_TREASURY_OFFSET 18080
+#define CITY_DATA_POPULATION_OFFSET 18104
+#define GAME_TIME_MONTH_OFFSET 8
+#define SCENARIO_NAME_OFFSET 31
+#define SCENARIO_CLIMATE_OFFSET 2662
 
-static char compress_buffer[COMPRESS_BUFFER_SIZE];
+static const int SAVE_GAME_VERSION = 0x66;
 
 static int savegame_version;
 
@@ -161,10 +179,33 @@ typedef struct {
 
 static struct {
     int num_pieces;
-    file_piece pieces[100];
+    file_piece pieces[MAX_SAVEGAME_PIECES];
     savegame_state state;
 } savegame_data = { 0 };
 
+static struct {
+    int num_pieces;
+    file_piece pieces[MAX_SAVEGAME_PIECES];
+    char filepath[2 * FILE_NAME_MAX];
+    platform_thread *thread;
+} background_save = { 0 };
+
+typedef struct {
+    uint8_t *data;
+    int length;
+} snapshot_delta;
+
+static struct {
+    uint8_t *newest;
+    uint8_t *incoming;
+    int size;
+    // Deltas that turn a snapshot into the one before it, newest first
+    snapshot_delta deltas[MAX_SNAPSHOTS];
+    int first_delta;
+    int count;
+    int delta_memory;
+} snapshots = { 0 };
+
 static void init_file_piece(file_piece *piece, int size, int compressed)
 {
     piece->compressed = compressed;
@@ -499,7 +540,7 @@ int game_file_io_write_scenario(const char *dir, const char *filename)
     init_scenario_data();
     scenario_save_to_state(&scenario_data.state);
 
-    static char filepath_to_save[2 * FILE_NAME_MAX];
+    char filepath_to_save[2 * FILE_NAME_MAX];
     filepath_to_save[2 * FILE_NAME_MAX - 1] = 0;
     prepend_dir_to_path(dir, filename, filepath_to_save);
 
@@ -512,6 +553,7 @@ int game_file_io_write_scenario(const char *dir, const char *filename)
         fwrite(scenario_data.pieces[i].buf.data, 1, scenario_data.pieces[i].buf.size, fp);
     }
     file_close(fp);
+    dir_invalidate_cache();
     return 1;
 }
 
@@ -535,87 +577,382 @@ static void write_int32(FILE *fp, int value)
     fwrite(&data, 1, 4, fp);
 }
 
-static int read_compressed_chunk(FILE *fp, void *buffer, int bytes_to_read)
+typedef struct {
+    const file_piece *pieces;
+    uint8_t **data;
+    const uint8_t **input;
+    int *sizes;
+    int *results;
+    int *times;
+    const int *order;
+    int num_ordered;
+    int num_tasks;
+    zip_compression_level level;
+} piece_job;
+
+// Keeps the pieces ordered largest first so the work spreads evenly over the tasks
+static void add_piece_to_order(const file_piece *pieces, int *order, int *num_ordered, int index)
+{
+    int i = (*num_ordered)++;
+    while (i > 0 && pieces[order[i - 1]].buf.size < pieces[index].buf.size) {
+        order[i] = order[i - 1];
+        i--;
+    }
+    order[i] = index;
+}
+
+static int get_num_piece_tasks(int num_ordered)
+{
+    int num_tasks = platform_thread_max_parallel_tasks();
+    return num_tasks < num_ordered ? num_tasks : num_ordered;
+}
+
+static void compress_pieces_task(int task_index, void *userdata)
+{
+    piece_job *job = (piece_job *) userdata;
+    uint8_t *scratch = (uint8_t *) malloc(COMPRESS_BUFFER_SIZE);
+    for (int i = task_index; i < job->num_ordered; i += job->num_tasks) {
+        int index = job->order[i];
+        const file_piece *piece = &job->pieces[index];
+        int output_size = COMPRESS_BUFFER_SIZE;
+        if (scratch && zip_compress(piece->buf.data, piece->buf.size, scratch, &output_size, job->level)) {
+            job->data[index] = (uint8_t *) malloc(output_size);
+            if (job->data[index]) {
+                memcpy(job->data[index], scratch, output_size);
+                job->sizes[index] = output_size;
+            }
+        }
+    }
+    free(scratch);
+}
+
+static void decompress_pieces_task(int task_index, void *userdata)
+{
+    piece_job *job = (piece_job *) userdata;
+    for (int i = task_index; i < job->num_ordered; i += job->num_tasks) {
+        int index = job->order[i];
+        const file_piece *piece = &job->pieces[index];
+        int output_size = piece->buf.size;
+        uint64_t start = platform_get_microseconds();
+        job->results[index] = zip_decompress(job->input[index], job->sizes[index], piece->buf.data, &output_size);
+        job->times[index] = (int) (platform_get_microseconds() - start);
+    }
+}
+
+static int read_compressed_piece(FILE *fp, const file_piece *piece, uint8_t **data, int *size)
 {
-    if (bytes_to_read > COMPRESS_BUFFER_SIZE) {
+    if (piece->buf.size > COMPRESS_BUFFER_SIZE) {
         return 0;
     }
     int input_size = read_int32(fp);
     if ((unsigned int) input_size == UNCOMPRESSED) {
-        if (fread(buffer, 1, bytes_to_read, fp) != (unsigned) bytes_to_read) {
+        return fread(piece->buf.data, 1, piece->buf.size, fp) == (unsigned) piece->buf.size;
+    }
+    if (input_size <= 0 || input_size > COMPRESS_BUFFER_SIZE) {
+        return 0;
+    }
+    *data = (uint8_t *) malloc(input_size);
+    if (!*data) {
+        return 0;
+    }
+    *size = input_size;
+    return fread(*data, 1, input_size, fp) == (unsigned) input_size;
+}
+
+// Finds the data of a piece in the file contents, the last piece may be shorter than its buffer
+static int find_piece_data(const uint8_t *contents, int size, int *position, const file_piece *piece,
+                           const uint8_t **data, int *data_size, int *compressed)
+{
+    int remaining = size - *position;
+    *compressed = 0;
+    if (piece->compressed) {
+        if (piece->buf.size > COMPRESS_BUFFER_SIZE || remaining < 4) {
             return 0;
         }
-    } else {
-        if (fread(compress_buffer, 1, input_size, fp) != (unsigned) input_size
-            || !zip_decompress(compress_buffer, input_size, buffer, &bytes_to_read)) {
-            return 0;
+        buffer buf;
+        buffer_init(&buf, (void *) &contents[*position], 4);
+        int input_size = buffer_read_i32(&buf);
+        *position += 4;
+        remaining -= 4;
+        if ((unsigned int) input_size != UNCOMPRESSED) {
+            if (input_size <= 0 || input_size > COMPRESS_BUFFER_SIZE || input_size > remaining) {
+                return 0;
+            }
+            *data = &contents[*position];
+            *data_size = input_size;
+            *compressed = 1;
+            *position += input_size;
+            return 1;
         }
     }
-    return 1;
+    *data = &contents[*position];
+    *data_size = remaining < piece->buf.size ? remaining : piece->buf.size;
+    *position += *data_size;
+    return *data_size == piece->buf.size;
 }
 
-static int write_compressed_chunk(FILE *fp, const void *buffer, int bytes_to_write)
+static int savegame_read_from_contents(const uint8_t *contents, int size)
 {
-    if (bytes_to_write > COMPRESS_BUFFER_SIZE) {
-        return 0;
+    int num_pieces = savegame_data.num_pieces;
+    const file_piece *pieces = savegame_data.pieces;
+    const uint8_t *input[MAX_SAVEGAME_PIECES] = { 0 };
+    int sizes[MAX_SAVEGAME_PIECES] = { 0 };
+    int results[MAX_SAVEGAME_PIECES];
+    int times[MAX_SAVEGAME_PIECES] = { 0 };
+    int order[MAX_SAVEGAME_PIECES];
+
+    // Locate all pieces first, then decompress them in parallel straight from the contents
+    int success = 1;
+    int position = 0;
+    int num_ordered = 0;
+    for (int i = 0; i < num_pieces && success; i++) {
+        const file_piece *piece = &pieces[i];
+        int compressed;
+        int result = find_piece_data(contents, size, &position, piece, &input[i], &sizes[i], &compressed);
+        if (compressed) {
+            add_piece_to_order(pieces, order, &num_ordered, i);
+        } else if (input[i]) {
+            memcpy(piece->buf.data, input[i], sizes[i]);
+        }
+        results[i] = result;
+        // The last piece may be smaller than buf.size
+        if (!result && i != (num_pieces - 1)) {
+            success = 0;
+        }
     }
-    int output_size = COMPRESS_BUFFER_SIZE;
-    if (zip_compress(buffer, bytes_to_write, compress_buffer, &output_size)) {
-        write_int32(fp, output_size);
-        fwrite(compress_buffer, 1, output_size, fp);
-    } else {
-        // unable to compress: write uncompressed
-        write_int32(fp, UNCOMPRESSED);
-        fwrite(buffer, 1, bytes_to_write, fp);
+    if (success && num_ordered) {
+        piece_job job = { pieces, 0, input, sizes, results, times, order, num_ordered, 0, ZIP_COMPRESSION_BEST };
+        job.num_tasks = get_num_piece_tasks(num_ordered);
+        uint64_t start = platform_get_microseconds();
+        platform_thread_run_tasks(decompress_pieces_task, job.num_tasks, &job);
+        int total_time = (int) (platform_get_microseconds() - start);
+        for (int i = 0; i < num_ordered; i++) {
+            if (!results[order[i]] && order[i] != (num_pieces - 1)) {
+                success = 0;
+            }
+            if (times[order[i]] >= PIECE_TIME_REPORT_THRESHOLD) {
+                uint8_t piece_index[12];
+                string_from_int(piece_index, order[i], 0);
+                log_info("Slow piece, index and decode time in microseconds:", (const char *) piece_index,
+                    times[order[i]]);
+            }
+        }
+        log_info("Decoded pieces, total time in microseconds:", 0, total_time);
     }
-    return 1;
+    return success;
 }
 
-static int savegame_read_from_file(FILE *fp)
+static void init_saved_game_view(saved_game_view *view, int pieces)
 {
-    for (int i = 0; i < savegame_data.num_pieces; i++) {
-        file_piece *piece = &savegame_data.pieces[i];
-        int result = 0;
-        if (piece->compressed) {
-            result = read_compressed_chunk(fp, piece->buf.data, piece->buf.size);
-        } else {
-            result = fread(piece->buf.data, 1, piece->buf.size, fp) == (unsigned) piece->buf.size;
+    const savegame_state *state = &savegame_data.state;
+    view->file_version = pieces & SAVED_GAME_PIECE_FILE_VERSION ? state->file_version : 0;
+    view->scenario = pieces & SAVED_GAME_PIECE_SCENARIO ? state->scenario : 0;
+    view->city_data = pieces & SAVED_GAME_PIECE_CITY_DATA ? state->city_data : 0;
+    view->game_time = pieces & SAVED_GAME_PIECE_GAME_TIME ? state->game_time : 0;
+    view->image_grid = pieces & SAVED_GAME_PIECE_IMAGE_GRID ? state->image_grid : 0;
+    view->terrain_grid = pieces & SAVED_GAME_PIECE_TERRAIN_GRID ? state->terrain_grid : 0;
+}
+
+static int is_piece_in_view(const buffer *buf, const saved_game_view *view)
+{
+    return buf == view->file_version || buf == view->scenario || buf == view->city_data ||
+        buf == view->game_time || buf == view->image_grid || buf == view->terrain_grid;
+}
+
+static int count_pieces(int pieces)
+{
+    int count = 0;
+    for (; pieces; pieces >>= 1) {
+        count += pieces & 1;
+    }
+    return count;
+}
+
+static int skip_piece(FILE *fp, const file_piece *piece)
+{
+    int size = piece->buf.size;
+    if (piece->compressed) {
+        int input_size = read_int32(fp);
+        if ((unsigned int) input_size != UNCOMPRESSED) {
+            if (input_size <= 0 || input_size > COMPRESS_BUFFER_SIZE) {
+                return 0;
+            }
+            size = input_size;
         }
-        // The last piece may be smaller than buf.size
-        if (!result && i != (savegame_data.num_pieces - 1)) {
+    }
+    return fseek(fp, size, SEEK_CUR) == 0;
+}
+
+static int read_piece(FILE *fp, const file_piece *piece)
+{
+    if (!piece->compressed) {
+        return fread(piece->buf.data, 1, piece->buf.size, fp) == (unsigned) piece->buf.size;
+    }
+    uint8_t *data = 0;
+    int size = 0;
+    int result = read_compressed_piece(fp, piece, &data, &size);
+    if (result && data) {
+        int output_size = piece->buf.size;
+        result = zip_decompress(data, size, piece->buf.data, &output_size);
+    }
+    free(data);
+    return result;
+}
+
+// Reads the pieces in the view, the other ones are skipped using their length without decompressing them
+static int savegame_read_view_from_file(FILE *fp, const saved_game_view *view, int pieces_left)
+{
+    for (int i = 0; i < savegame_data.num_pieces && pieces_left > 0; i++) {
+        const file_piece *piece = &savegame_data.pieces[i];
+        if (!is_piece_in_view(&piece->buf, view)) {
+            if (!skip_piece(fp, piece)) {
+                return 0;
+            }
+        } else if (read_piece(fp, piece)) {
+            pieces_left--;
+        } else {
             return 0;
         }
     }
-    return 1;
+    return pieces_left == 0;
 }
 
-static void savegame_write_to_file(FILE *fp)
+static void savegame_load_info_from_view(const saved_game_view *view, saved_game_info *info)
 {
-    for (int i = 0; i < savegame_data.num_pieces; i++) {
-        file_piece *piece = &savegame_data.pieces[i];
-        if (piece->compressed) {
-            write_compressed_chunk(fp, piece->buf.data, piece->buf.size);
+    buffer_set(view->city_data, CITY_DATA_TREASURY_OFFSET);
+    info->treasury = buffer_read_i32(view->city_data);
+    buffer_set(view->city_data, CITY_DATA_POPULATION_OFFSET);
+    info->population = buffer_read_i32(view->city_data);
+
+    buffer_set(view->game_time, GAME_TIME_MONTH_OFFSET);
+    info->month = buffer_read_i32(view->game_time);
+    info->year = buffer_read_i32(view->game_time);
+
+    buffer_set(view->scenario, SCENARIO_NAME_OFFSET);
+    buffer_read_raw(view->scenario, info->scenario_name, MAX_SCENARIO_NAME);
+    info->scenario_name[MAX_SCENARIO_NAME - 1] = 0;
+    buffer_set(view->scenario, SCENARIO_CLIMATE_OFFSET);
+    info->climate = buffer_read_u8(view->scenario);
+}
+
+static void savegame_write_to_file(FILE *fp, const file_piece *pieces, int num_pieces,
+                                   zip_compression_level level)
+{
+    uint8_t *data[MAX_SAVEGAME_PIECES] = { 0 };
+    int sizes[MAX_SAVEGAME_PIECES] = { 0 };
+    int order[MAX_SAVEGAME_PIECES];
+
+    // Compress the pieces in parallel, then write them in file order
+    int num_ordered = 0;
+    for (int i = 0; i < num_pieces; i++) {
+        if (pieces[i].compressed && pieces[i].buf.size <= COMPRESS_BUFFER_SIZE) {
+            add_piece_to_order(pieces, order, &num_ordered, i);
+        }
+    }
+    if (num_ordered) {
+        piece_job job = { pieces, data, 0, sizes, 0, 0, order, num_ordered, 0, level };
+        job.num_tasks = get_num_piece_tasks(num_ordered);
+        platform_thread_run_tasks(compress_pieces_task, job.num_tasks, &job);
+    }
+    for (int i = 0; i < num_pieces; i++) {
+        const file_piece *piece = &pieces[i];
+        if (!piece->compressed) {
+            fwrite(piece->buf.data, 1, piece->buf.size, fp);
+        } else if (piece->buf.size > COMPRESS_BUFFER_SIZE) {
+            continue;
+        } else if (data[i]) {
+            write_int32(fp, sizes[i]);
+            fwrite(data[i], 1, sizes[i], fp);
+            free(data[i]);
         } else {
+            // unable to compress: write uncompressed
+            write_int32(fp, UNCOMPRESSED);
             fwrite(piece->buf.data, 1, piece->buf.size, fp);
         }
     }
 }
 
+static int savegame_write_file(const char *filepath, const file_piece *pieces, int num_pieces,
+                               zip_compression_level level)
+{
+    // Write to a temporary file first so an interrupted save never corrupts an existing one
+    char temp_filepath[2 * FILE_NAME_MAX + 4];
+    strcpy(temp_filepath, filepath);
+    strcat(temp_filepath, ".tmp");
+
+    FILE *fp = file_open(temp_filepath, "wb");
+    if (!fp) {
+        return 0;
+    }
+    savegame_write_to_file(fp, pieces, num_pieces, level);
+    int result = !ferror(fp);
+    if (file_close(fp) != 0) {
+        result = 0;
+    }
+    if (result) {
+        result = platform_file_manager_rename_file(temp_filepath, filepath);
+    }
+    if (!result) {
+        platform_file_manager_remove_file(0, temp_filepath);
+    }
+    return result;
+}
+
+static int write_background_save(__attribute__((unused)) void *userdata)
+{
+    // Autosaves favour speed over size
+    return savegame_write_file(background_save.filepath, background_save.pieces, background_save.num_pieces,
+                               ZIP_COMPRESSION_FAST);
+}
+
+void game_file_io_wait_for_background_save(void)
+{
+    if (!background_save.thread) {
+        return;
+    }
+    int result = platform_thread_wait(background_save.thread);
+    background_save.thread = 0;
+    dir_invalidate_cache();
+    if (!result) {
+        log_error("Unable to save game", background_save.filepath, 0);
+    }
+}
+
+static void init_background_save(void)
+{
+    if (background_save.num_pieces) {
+        return;
+    }
+    for (int i = 0; i < savegame_data.num_pieces; i++) {
+        const file_piece *piece = &savegame_data.pieces[i];
+        init_file_piece(&background_save.pieces[i], piece->buf.size, piece->compressed);
+    }
+    background_save.num_pieces = savegame_data.num_pieces;
+}
+
 int game_file_io_read_saved_game(const char *dir, const char *filename, int offset)
 {
+    game_file_io_wait_for_background_save();
     init_savegame_data();
 
     log_info("Loading saved game", filename, 0);
-    FILE *fp = file_open(get_case_corrected_file(dir, filename), "rb");
-    if (!fp) {
+    // io_map_file only corrects the case of paths relative to the working directory
+    const char *cased_file = get_case_corrected_file(dir, filename);
+    if (!cased_file) {
         log_error("Unable to load game", 0, 0);
         return 0;
     }
-    if (offset) {
-        fseek(fp, offset, SEEK_SET);
+    char filepath[2 * FILE_NAME_MAX];
+    filepath[2 * FILE_NAME_MAX - 1] = 0;
+    strncpy(filepath, cased_file, 2 * FILE_NAME_MAX - 1);
+    io_mapped_file file;
+    if (!io_map_file(filepath, &file)) {
+        log_error("Unable to load game", 0, 0);
+        return 0;
     }
-    int result = savegame_read_from_file(fp);
-    file_close(fp);
+    int result = offset >= 0 && offset <= file.size &&
+        savegame_read_from_contents(&file.data[offset], file.size - offset);
+    io_unmap_file(&file);
     if (!result) {
         log_error("Unable to load game", 0, 0);
         return 0;
@@ -624,32 +961,251 @@ int game_file_io_read_saved_game(const char *dir, const char *filename, int offs
     return 1;
 }
 
+int game_file_io_read_saved_game_pieces(const char *dir, const char *filename, int pieces, saved_game_view *view)
+{
+    init_savegame_data();
+    init_saved_game_view(view, pieces);
+
+    const char *filepath = get_case_corrected_file(dir, filename);
+    FILE *fp = filepath ? file_open(filepath, "rb") : 0;
+    if (!fp) {
+        return 0;
+    }
+    int result = savegame_read_view_from_file(fp, view, count_pieces(pieces & SAVED_GAME_PIECE_ALL));
+    file_close(fp);
+    return result;
+}
+
+int game_file_io_read_saved_game_info(const char *dir, const char *filename, saved_game_info *info)
+{
+    saved_game_view view;
+    if (!game_file_io_read_saved_game_pieces(dir, filename,
+            SAVED_GAME_PIECE_SCENARIO | SAVED_GAME_PIECE_CITY_DATA | SAVED_GAME_PIECE_GAME_TIME, &view)) {
+        return 0;
+    }
+    savegame_load_info_from_view(&view, info);
+    return 1;
+}
+
 int game_file_io_write_saved_game(const char *dir, const char *filename)
 {
+    game_file_io_wait_for_background_save();
     init_savegame_data();
 
     log_info("Saving game", filename, 0);
+    game_save_index_invalidate(dir, filename);
     savegame_version = SAVE_GAME_VERSION;
     savegame_save_to_state(&savegame_data.state);
 
-    static char filepath_to_save[2 * FILE_NAME_MAX];
+    char filepath_to_save[2 * FILE_NAME_MAX];
     filepath_to_save[2 * FILE_NAME_MAX - 1] = 0;
     prepend_dir_to_path(dir, filename, filepath_to_save);
 
-    FILE *fp = file_open(filepath_to_save, "wb");
-    if (!fp) {
+    int result = savegame_write_file(filepath_to_save, savegame_data.pieces, savegame_data.num_pieces,
+                                     ZIP_COMPRESSION_BEST);
+    dir_invalidate_cache();
+    if (!result) {
         log_error("Unable to save game", 0, 0);
         return 0;
     }
-    savegame_write_to_file(fp);
-    file_close(fp);
     return 1;
 }
 
+int game_file_io_write_saved_game_in_background(const char *dir, const char *filename)
+{
+    // A save still in flight is finished first so saves reach the disk in order
+    game_file_io_wait_for_background_save();
+    init_savegame_data();
+    init_background_save();
+
+    log_info("Saving game in background", filename, 0);
+    game_save_index_invalidate(dir, filename);
+    savegame_version = SAVE_GAME_VERSION;
+    savegame_save_to_state(&savegame_data.state);
+    for (int i = 0; i < savegame_data.num_pieces; i++) {
+        memcpy(background_save.pieces[i].buf.data, savegame_data.pieces[i].buf.data, savegame_data.pieces[i].buf.size);
+    }
+    background_save.filepath[2 * FILE_NAME_MAX - 1] = 0;
+    prepend_dir_to_path(dir, filename, background_save.filepath);
+
+    background_save.thread = platform_thread_create(write_background_save, "save", 0);
+    if (!background_save.thread && !write_background_save(0)) {
+        log_error("Unable to save game", 0, 0);
+        return 0;
+    }
+    return 1;
+}
+
+static int get_savegame_size(void)
+{
+    int size = 0;
+    for (int i = 0; i < savegame_data.num_pieces; i++) {
+        size += savegame_data.pieces[i].buf.size;
+    }
+    return size;
+}
+
+static snapshot_delta *get_snapshot_delta(int age)
+{
+    return &snapshots.deltas[(snapshots.first_delta + age - 1) % MAX_SNAPSHOTS];
+}
+
+static void drop_oldest_snapshot(void)
+{
+    snapshot_delta *delta = get_snapshot_delta(snapshots.count - 1);
+    snapshots.delta_memory -= delta->length;
+    free(delta->data);
+    delta->data = 0;
+    delta->length = 0;
+    snapshots.count--;
+}
+
+static void drop_newest_delta(void)
+{
+    snapshot_delta *delta = get_snapshot_delta(1);
+    snapshots.delta_memory -= delta->length;
+    free(delta->data);
+    delta->data = 0;
+    delta->length = 0;
+    snapshots.first_delta = (snapshots.first_delta + 1) % MAX_SNAPSHOTS;
+    snapshots.count--;
+}
+
+static void clear_snapshot_history(void)
+{
+    while (snapshots.count > 1) {
+        drop_oldest_snapshot();
+    }
+    snapshots.count = 0;
+    // Start a fresh delta chain so nothing links back to the previous game
+    snapshots.first_delta = 0;
+    snapshots.delta_memory = 0;
+}
+
+static int init_snapshots(int size)
+{
+    if (snapshots.newest) {
+        return 1;
+    }
+    snapshots.newest = (uint8_t *) malloc(size);
+    snapshots.incoming = (uint8_t *) malloc(size);
+    if (!snapshots.newest || !snapshots.incoming) {
+        free(snapshots.newest);
+        free(snapshots.incoming);
+        snapshots.newest = 0;
+        snapshots.incoming = 0;
+        return 0;
+    }
+    snapshots.size = size;
+    return 1;
+}
+
+static int add_snapshot_delta(void)
+{
+    if (snapshots.count == MAX_SNAPSHOTS) {
+        drop_oldest_snapshot();
+    }
+    int length = delta_max_encoded_length(snapshots.size);
+    uint8_t *data = (uint8_t *) malloc(length);
+    // A delta larger than a full snapshot is not worth keeping
+    if (!data || !delta_encode(snapshots.incoming, snapshots.newest, snapshots.size, data, &length) ||
+        length > snapshots.size) {
+        free(data);
+        return 0;
+    }
+    uint8_t *shrunk = (uint8_t *) realloc(data, length > 0 ? length : 1);
+    snapshots.first_delta = (snapshots.first_delta + MAX_SNAPSHOTS - 1) % MAX_SNAPSHOTS;
+    snapshot_delta *delta = get_snapshot_delta(1);
+    delta->data = shrunk ? shrunk : data;
+    delta->length = length;
+    snapshots.delta_memory += length;
+    return 1;
+}
+
+int game_file_io_take_snapshot(void)
+{
+    int max_snapshots = calc_bound(config_get(CONFIG_GAME_SNAPSHOT_COUNT), 0, MAX_SNAPSHOTS);
+    if (!max_snapshots) {
+        return 0;
+    }
+    uint64_t start = platform_get_microseconds();
+    init_savegame_data();
+    savegame_version = SAVE_GAME_VERSION;
+    savegame_save_to_state(&savegame_data.state);
+
+    int size = get_savegame_size();
+    if (!init_snapshots(size)) {
+        log_error("Not enough memory for snapshot", 0, size);
+        return 0;
+    }
+    uint8_t *data = snapshots.incoming;
+    for (int i = 0; i < savegame_data.num_pieces; i++) {
+        const buffer *buf = &savegame_data.pieces[i].buf;
+        memcpy(data, buf->data, buf->size);
+        data += buf->size;
+    }
+    if (snapshots.count > 0 && !add_snapshot_delta()) {
+        log_info("Snapshot differs too much from the previous one, history restarted", 0, 0);
+        clear_snapshot_history();
+    }
+    uint8_t *newest = snapshots.newest;
+    snapshots.newest = snapshots.incoming;
+    snapshots.incoming = newest;
+    snapshots.count++;
+
+    int memory_limit = calc_bound(config_get(CONFIG_GAME_SNAPSHOT_MEMORY_LIMIT), 1, MAX_SNAPSHOT_MEMORY_MB) * 1024 * 1024;
+    while (snapshots.count > max_snapshots || (snapshots.count > 1 && snapshots.delta_memory > memory_limit)) {
+        drop_oldest_snapshot();
+    }
+    log_info("Snapshot taken, delta bytes:", 0, snapshots.count > 1 ? get_snapshot_delta(1)->length : size);
+    log_info("Snapshot history:", 0, snapshots.count);
+    log_info("Snapshot memory in use, bytes:", 0, 2 * snapshots.size + snapshots.delta_memory);
+    log_info("Snapshot time in microseconds:", 0, (int) (platform_get_microseconds() - start));
+    return 1;
+}
+
+int game_file_io_restore_snapshot(int age)
+{
+    if (age < 0 || age >= snapshots.count) {
+        return 0;
+    }
+    uint64_t start = platform_get_microseconds();
+    // Snapshots newer than the restored one belong to a timeline that no longer exists
+    for (int i = 0; i < age; i++) {
+        const snapshot_delta *delta = get_snapshot_delta(1);
+        if (!delta_apply(snapshots.newest, snapshots.size, delta->data, delta->length)) {
+            log_error("Invalid snapshot delta, history cleared", 0, 0);
+            clear_snapshot_history();
+            return 0;
+        }
+        drop_newest_delta();
+    }
+    init_savegame_data();
+    const uint8_t *data = snapshots.newest;
+    for (int i = 0; i < savegame_data.num_pieces; i++) {
+        buffer *buf = &savegame_data.pieces[i].buf;
+        memcpy(buf->data, data, buf->size);
+        data += buf->size;
+    }
+    savegame_load_from_state(&savegame_data.state);
+
+    log_info("Snapshot restored, age:", 0, age);
+    log_info("Snapshot time in microseconds:", 0, (int) (platform_get_microseconds() - start));
+    return 1;
+}
+
+void game_file_io_clear_snapshots(void)
+{
+    clear_snapshot_history();
+}
+
 int game_file_io_delete_saved_game(const char *dir, const char *filename)
 {
+    game_file_io_wait_for_background_save();
     log_info("Deleting game", filename, 0);
+    game_save_index_invalidate(dir, filename);
     int result = platform_file_manager_remove_file(dir, filename);
+    dir_invalidate_cache();
     if (!result) {
         log_error("Unable to delete game", 0, 0);
     }
@@ -1,14 +1,98 @@
 #ifndef GAME_FILE_IO_H
 #define GAME_FILE_IO_H
 
+#include "core/buffer.h"
+#include "scenario/data.h"
+
+#include <stdint.h>
+
+typedef struct {
+    int month;
+    int year;
+    int population;
+    int treasury;
+    int climate;
+    uint8_t scenario_name[MAX_SCENARIO_NAME];
+} saved_game_info;
+
+/**
+ * Pieces of a saved game that can be read without loading the game
+ */
+enum {
+    SAVED_GAME_PIECE_FILE_VERSION = 0x1,
+    SAVED_GAME_PIECE_SCENARIO = 0x2,
+    SAVED_GAME_PIECE_CITY_DATA = 0x4,
+    SAVED_GAME_PIECE_GAME_TIME = 0x8,
+    SAVED_GAME_PIECE_IMAGE_GRID = 0x10,
+    SAVED_GAME_PIECE_TERRAIN_GRID = 0x20,
+    SAVED_GAME_PIECE_ALL = 0x3f
+};
+
+/**
+ * Read-only view on the pieces of a saved game, pieces that were not requested are null.
+ * The buffers are only valid until the next saved game is read or written.
+ */
+typedef struct {
+    buffer *file_version;
+    buffer *scenario;
+    buffer *city_data;
+    buffer *game_time;
+    buffer *image_grid;
+    buffer *terrain_grid;
+} saved_game_view;
+
 int game_file_io_read_scenario(const char *dir, const char *filename);
 
 int game_file_io_write_scenario(const char *dir, const char *filename);
 
 int game_file_io_read_saved_game(const char *dir, const char *filename, int offset);
 
+/**
+ * Reads some pieces of a saved game without loading it. The other pieces are skipped
+ * without decompressing them.
+ * @param dir Directory of the saved game
+ * @param filename Saved game file
+ * @param pieces Pieces to read, a combination of SAVED_GAME_PIECE_* flags
+ * @param view View to fill
+ * @return boolean true on success, false on error
+ */
+int game_file_io_read_saved_game_pieces(const char *dir, const char *filename, int pieces, saved_game_view *view);
+
+/**
+ * Reads the summary of a saved game without loading it
+ * @param dir Directory of the saved game
+ * @param filename Saved game file
+ * @param info Summary to fill
+ * @return boolean true on success, false on error
+ */
+int game_file_io_read_saved_game_info(const char *dir, const char *filename, saved_game_info *info);
+
 int game_file_io_write_saved_game(const char *dir, const char *filename);
 
+int game_file_io_write_saved_game_in_background(const char *dir, const char *filename);
+
+void game_file_io_wait_for_background_save(void);
+
 int game_file_io_delete_saved_game(const char *dir, const char *filename);
 
+/**
+ * Keeps a copy of the current game in memory. The newest snapshot is stored
+ * in full, older ones as deltas against their successor. The oldest ones are
+ * dropped when the configured number of snapshots or memory limit is exceeded.
+ * @return boolean true on success, false if snapshots are disabled or out of memory
+ */
+int game_file_io_take_snapshot(void);
+
+/**
+ * Restores the game from an in-memory snapshot. Newer snapshots are discarded.
+ * @param age Snapshot to restore, 0 for the newest one
+ * @return boolean true on success, false if there is no such snapshot
+ */
+int game_file_io_restore_snapshot(int age);
+
+/**
+ * Forgets all snapshots, for example when a different game is loaded
+ */
+void game_file_io_clear_snapshots(void);
+
 #endif // GAME_FILE_IO_H
@@ -13,13 +13,18 @@
 #include "game/animation.h"
 #include "game/custom_strings.h"
 #include "game/file_editor.h"
+#include "game/file_io.h"
 #include "game/settings.h"
 #include "game/speed.h"
 #include "game/state.h"
+#include "game/system.h"
 #include "game/tick.h"
 #include "graphics/font.h"
+#include "graphics/image.h"
 #include "graphics/video.h"
 #include "graphics/window.h"
+#include "platform/platform.h"
+#include "platform/thread.h"
 #include "scenario/property.h"
 #include "scenario/scenario.h"
 #include "sound/city.h"
@@ -28,11 +33,93 @@
 #include "window/logo.h"
 #include "window/main_menu.h"
 
+typedef struct {
+    const char *name;
+    int (*run)(void);
+    const char *error;
+    int result;
+    int micros;
+} startup_task;
+
+static int load_enemy_images(void)
+{
+    return image_load_enemy(ENEMY_0_BARBARIAN);
+}
+
+/**
+ * Loads that the logo window does not need: they run on worker threads
+ * while the main thread loads the main graphics and opens the sound device
+ */
+static startup_task background_tasks[] = {
+    { "enemy graphics", load_enemy_images, "unable to load enemy graphics", 0, 0 },
+    { "c3_model.txt", model_load, "unable to load c3_model.txt", 0, 0 },
+};
+
+#define NUM_BACKGROUND_TASKS ((int) (sizeof(background_tasks) / sizeof(startup_task)))
+
+static struct {
+    int pending;
+    int frame_drawn;
+    platform_thread *thread;
+    uint64_t start_time;
+} startup;
+
 static void errlog(const char *msg)
 {
     log_error(msg, 0, 0);
 }
 
+static int run_startup_task(startup_task *task)
+{
+    uint64_t start = platform_get_microseconds();
+    task->result = task->run();
+    task->micros = (int) (platform_get_microseconds() - start);
+    log_info("Startup task done, microseconds:", task->name, task->micros);
+    return task->result;
+}
+
+static void run_background_task(int task_index, __attribute__((unused)) void *userdata)
+{
+    run_startup_task(&background_tasks[task_index]);
+}
+
+static int run_background_tasks(__attribute__((unused)) void *userdata)
+{
+    platform_thread_run_tasks(run_background_task, NUM_BACKGROUND_TASKS, 0);
+    return 0;
+}
+
+static void start_background_tasks(void)
+{
+    startup.pending = 1;
+    startup.start_time = platform_get_microseconds();
+    startup.thread = platform_thread_create(run_background_tasks, "startup", 0);
+    if (!startup.thread) {
+        run_background_tasks(0);
+    }
+}
+
+static int finish_background_tasks(void)
+{
+    if (!startup.pending) {
+        return 1;
+    }
+    startup.pending = 0;
+    if (startup.thread) {
+        platform_thread_wait(startup.thread);
+        startup.thread = 0;
+    }
+    int result = 1;
+    for (int i = 0; i < NUM_BACKGROUND_TASKS; i++) {
+        if (!background_tasks[i].result) {
+            errlog(background_tasks[i].error);
+            result = 0;
+        }
+    }
+    log_info("Startup loading done, microseconds:", 0, (int) (platform_get_microseconds() - startup.start_time));
+    return result;
+}
+
 static encoding_type update_encoding(void)
 {
     encoding_type encoding = encoding_determine();
@@ -67,29 +154,37 @@ static int is_unpatched(void)
     return difficulty_option == help_menu;
 }
 
+static int load_main_images(void)
+{
+    return image_load_climate(CLIMATE_CENTRAL, 0, 1);
+}
+
+static int init_sound(void)
+{
+    sound_system_init();
+    return 1;
+}
+
 int game_init(void)
 {
     if (!image_init()) {
         errlog("unable to init graphics");
         return 0;
     }
-    if (!image_load_climate(CLIMATE_CENTRAL, 0, 1)) {
-        errlog("unable to load main graphics");
-        return 0;
-    }
-    if (!image_load_enemy(ENEMY_0_BARBARIAN)) {
-        errlog("unable to load enemy graphics");
-        return 0;
-    }
+    start_background_tasks();
 
-    if (!model_load()) {
-        errlog("unable to load c3_model.txt");
+    startup_task main_images = { "main graphics", load_main_images, "unable to load main graphics", 0, 0 };
+    if (!run_startup_task(&main_images)) {
+        errlog(main_images.error);
+        finish_background_tasks();
         return 0;
     }
 
     load_custom_messages();
-    sound_system_init();
+    startup_task sound = { "sound", init_sound, 0, 0, 0 };
+    run_startup_task(&sound);
     game_state_init();
+    // The remaining loads are finished once the logo has been drawn
     window_logo_show((is_unpatched() ? MESSAGE_MISSING_PATCH : MESSAGE_NONE));
 
     return 1;
@@ -97,6 +192,9 @@ int game_init(void)
 
 static int reload_language(int is_editor, int reload_images)
 {
+    if (!finish_background_tasks()) {
+        return 0;
+    }
     if (!lang_load(is_editor)) {
         if (is_editor) {
             errlog("'c3_map.eng' or 'c3_map_mm.eng' files not found or too large.");
@@ -150,6 +248,10 @@ int game_reload_language(void)
 
 void game_run(void)
 {
+    if (startup.pending && startup.frame_drawn && !finish_background_tasks()) {
+        system_exit();
+        return;
+    }
     game_animation_update();
     int num_ticks = game_speed_get_elapsed_ticks();
     for (int i = 0; i < num_ticks; i++) {
@@ -163,12 +265,17 @@ void game_run(void)
 
 void game_draw(void)
 {
+    image_begin_frame();
+    image_update_letter_atlas();
     window_draw(0);
     sound_city_play();
+    startup.frame_drawn = 1;
 }
 
 void game_exit(void)
 {
+    finish_background_tasks();
+    game_file_io_wait_for_background_save();
     video_shutdown();
     settings_save();
     config_save();
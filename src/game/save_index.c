@@ -0,0 +1,300 @@
+#include "save_index.h"
+
+#include "core/buffer.h"
+#include "core/dir.h"
+#include "core/file.h"
+#include "core/io.h"
+#include "core/log.h"
+#include "platform/file_manager.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define INDEX_FILENAME "savegames.idx"
+#define INDEX_VERSION 1
+#define HEADER_SIZE 12
+#define ENTRY_SIZE (FILE_NAME_MAX + 8 + 8 + 1 + 16 + 1 + MAX_SCENARIO_NAME)
+#define MIN_ENTRIES 64
+#define NO_ENTRY -1
+#define UNKNOWN_TIME -1
+
+static const uint8_t INDEX_MAGIC[4] = { 'B', 'S', 'G', 'I' };
+
+typedef struct {
+    char filename[FILE_NAME_MAX];
+    int64_t modified_time;
+    int64_t size;
+    int is_readable;
+    int is_checked;
+    saved_game_info info;
+} index_entry;
+
+static struct {
+    char dir[2 * FILE_NAME_MAX];
+    int loaded;
+    int changed;
+    index_entry *entries;
+    int num_entries;
+    int max_entries;
+    int *hash_table;
+    int hash_size;
+} data;
+
+static unsigned int hash_filename(const char *filename)
+{
+    unsigned int hash = 2166136261u;
+    while (*filename) {
+        hash ^= (uint8_t) *filename++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static int find_slot(const char *filename)
+{
+    unsigned int mask = (unsigned int) data.hash_size - 1;
+    unsigned int slot = hash_filename(filename) & mask;
+    while (data.hash_table[slot] != NO_ENTRY &&
+        strcmp(data.entries[data.hash_table[slot]].filename, filename) != 0) {
+        slot = (slot + 1) & mask;
+    }
+    return (int) slot;
+}
+
+static int resize_hash_table(int hash_size)
+{
+    int *hash_table = (int *) malloc(hash_size * sizeof(int));
+    if (!hash_table) {
+        return 0;
+    }
+    free(data.hash_table);
+    data.hash_table = hash_table;
+    data.hash_size = hash_size;
+    for (int i = 0; i < hash_size; i++) {
+        data.hash_table[i] = NO_ENTRY;
+    }
+    for (int i = 0; i < data.num_entries; i++) {
+        data.hash_table[find_slot(data.entries[i].filename)] = i;
+    }
+    return 1;
+}
+
+static index_entry *find_entry(const char *filename)
+{
+    if (!data.num_entries) {
+        return 0;
+    }
+    int index = data.hash_table[find_slot(filename)];
+    return index == NO_ENTRY ? 0 : &data.entries[index];
+}
+
+static index_entry *add_entry(const char *filename)
+{
+    if (data.num_entries >= data.max_entries) {
+        int max_entries = data.max_entries ? 2 * data.max_entries : MIN_ENTRIES;
+        index_entry *entries = (index_entry *) realloc(data.entries, max_entries * sizeof(index_entry));
+        if (!entries) {
+            return 0;
+        }
+        data.entries = entries;
+        data.max_entries = max_entries;
+    }
+    // Keep the hash table at most half full
+    if (2 * (data.num_entries + 1) > data.hash_size &&
+        !resize_hash_table(data.hash_size ? 2 * data.hash_size : 2 * MIN_ENTRIES)) {
+        return 0;
+    }
+    index_entry *entry = &data.entries[data.num_entries];
+    memset(entry, 0, sizeof(index_entry));
+    strncpy(entry->filename, filename, FILE_NAME_MAX - 1);
+    entry->modified_time = UNKNOWN_TIME;
+    data.hash_table[find_slot(entry->filename)] = data.num_entries++;
+    return entry;
+}
+
+static const char *get_index_path(const char *dir)
+{
+    static char filepath[2 * FILE_NAME_MAX];
+    filepath[2 * FILE_NAME_MAX - 1] = 0;
+    prepend_dir_to_path(dir, INDEX_FILENAME, filepath);
+    return filepath;
+}
+
+static int64_t read_i64(buffer *buf)
+{
+    uint32_t low = buffer_read_u32(buf);
+    int32_t high = buffer_read_i32(buf);
+    return (int64_t) (((uint64_t) (uint32_t) high << 32) | low);
+}
+
+static void write_i64(buffer *buf, int64_t value)
+{
+    buffer_write_u32(buf, (uint32_t) ((uint64_t) value & 0xffffffffu));
+    buffer_write_i32(buf, (int32_t) ((uint64_t) value >> 32));
+}
+
+static void read_entry(buffer *buf, index_entry *entry)
+{
+    entry->modified_time = read_i64(buf);
+    entry->size = read_i64(buf);
+    entry->is_readable = buffer_read_u8(buf);
+    entry->info.month = buffer_read_i32(buf);
+    entry->info.year = buffer_read_i32(buf);
+    entry->info.population = buffer_read_i32(buf);
+    entry->info.treasury = buffer_read_i32(buf);
+    entry->info.climate = buffer_read_u8(buf);
+    buffer_read_raw(buf, entry->info.scenario_name, MAX_SCENARIO_NAME);
+    entry->info.scenario_name[MAX_SCENARIO_NAME - 1] = 0;
+}
+
+static void write_entry(buffer *buf, const index_entry *entry)
+{
+    buffer_write_raw(buf, entry->filename, FILE_NAME_MAX);
+    write_i64(buf, entry->modified_time);
+    write_i64(buf, entry->size);
+    buffer_write_u8(buf, (uint8_t) entry->is_readable);
+    buffer_write_i32(buf, entry->info.month);
+    buffer_write_i32(buf, entry->info.year);
+    buffer_write_i32(buf, entry->info.population);
+    buffer_write_i32(buf, entry->info.treasury);
+    buffer_write_u8(buf, (uint8_t) entry->info.climate);
+    buffer_write_raw(buf, entry->info.scenario_name, MAX_SCENARIO_NAME);
+}
+
+static void read_index_file(const char *dir)
+{
+    io_mapped_file file;
+    if (!io_map_file(get_index_path(dir), &file)) {
+        return;
+    }
+    buffer buf;
+    buffer_init(&buf, file.data, file.size);
+    uint8_t magic[4];
+    int num_entries = 0;
+    if (file.size >= HEADER_SIZE) {
+        buffer_read_raw(&buf, magic, 4);
+        int version = buffer_read_i32(&buf);
+        num_entries = buffer_read_i32(&buf);
+        if (memcmp(magic, INDEX_MAGIC, 4) != 0 || version != INDEX_VERSION ||
+            num_entries < 0 || num_entries > (file.size - HEADER_SIZE) / ENTRY_SIZE) {
+            log_error("Ignoring invalid saved game index", INDEX_FILENAME, 0);
+            num_entries = 0;
+        }
+    }
+    for (int i = 0; i < num_entries; i++) {
+        char filename[FILE_NAME_MAX];
+        buffer_read_raw(&buf, filename, FILE_NAME_MAX);
+        filename[FILE_NAME_MAX - 1] = 0;
+        index_entry *entry = find_entry(filename);
+        if (!entry) {
+            entry = add_entry(filename);
+        }
+        if (!entry) {
+            break;
+        }
+        read_entry(&buf, entry);
+    }
+    io_unmap_file(&file);
+}
+
+void game_save_index_save(void)
+{
+    if (!data.loaded || !data.changed) {
+        return;
+    }
+    int num_entries = 0;
+    for (int i = 0; i < data.num_entries; i++) {
+        if (data.entries[i].modified_time != UNKNOWN_TIME) {
+            num_entries++;
+        }
+    }
+    int size = HEADER_SIZE + num_entries * ENTRY_SIZE;
+    uint8_t *contents = (uint8_t *) malloc(size);
+    if (!contents) {
+        return;
+    }
+    buffer buf;
+    buffer_init(&buf, contents, size);
+    buffer_write_raw(&buf, INDEX_MAGIC, 4);
+    buffer_write_i32(&buf, INDEX_VERSION);
+    buffer_write_i32(&buf, num_entries);
+    for (int i = 0; i < data.num_entries; i++) {
+        if (data.entries[i].modified_time != UNKNOWN_TIME) {
+            write_entry(&buf, &data.entries[i]);
+        }
+    }
+    if (io_write_buffer_to_file(get_index_path(data.dir), contents, size) == size) {
+        data.changed = 0;
+    }
+    free(contents);
+}
+
+static void load_index(const char *dir)
+{
+    if (data.loaded && strcmp(data.dir, dir) == 0) {
+        return;
+    }
+    game_save_index_save();
+    data.num_entries = 0;
+    for (int i = 0; i < data.hash_size; i++) {
+        data.hash_table[i] = NO_ENTRY;
+    }
+    strncpy(data.dir, dir, 2 * FILE_NAME_MAX - 1);
+    data.loaded = 1;
+    data.changed = 0;
+    read_index_file(dir);
+}
+
+const saved_game_info *game_save_index_get(const char *dir, const char *filename)
+{
+    load_index(dir);
+    index_entry *entry = find_entry(filename);
+    if (!entry) {
+        entry = add_entry(filename);
+        if (!entry) {
+            return 0;
+        }
+    }
+    if (!entry->is_checked) {
+        entry->is_checked = 1;
+        int64_t modified_time;
+        int64_t size;
+        const char *filepath = get_case_corrected_file(dir, filename);
+        if (!filepath || !platform_file_manager_get_file_info(filepath, &modified_time, &size)) {
+            if (entry->modified_time != UNKNOWN_TIME) {
+                entry->modified_time = UNKNOWN_TIME;
+                data.changed = 1;
+            }
+            entry->is_readable = 0;
+            return 0;
+        }
+        if (modified_time != entry->modified_time || size != entry->size) {
+            entry->modified_time = modified_time;
+            entry->size = size;
+            entry->is_readable = game_file_io_read_saved_game_info(dir, filename, &entry->info);
+            data.changed = 1;
+        }
+    }
+    return entry->is_readable ? &entry->info : 0;
+}
+
+void game_save_index_refresh(void)
+{
+    for (int i = 0; i < data.num_entries; i++) {
+        data.entries[i].is_checked = 0;
+    }
+}
+
+void game_save_index_invalidate(const char *dir, const char *filename)
+{
+    if (!data.loaded || strcmp(data.dir, dir) != 0) {
+        // The modification time catches changes when the index is loaded later
+        return;
+    }
+    index_entry *entry = find_entry(filename);
+    if (entry) {
+        entry->modified_time = UNKNOWN_TIME;
+        entry->is_checked = 0;
+        data.changed = 1;
+    }
+}
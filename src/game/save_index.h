@@ -0,0 +1,37 @@
+#ifndef GAME_SAVE_INDEX_H
+#define GAME_SAVE_INDEX_H
+
+#include "game/file_io.h"
+
+/**
+ * @file
+ * Cached summaries of the saved games in a directory.
+ */
+
+/**
+ * Gets the summary of a saved game. The file is only read when its
+ * modification time or size changed since it was last indexed.
+ * @param dir Directory of the saved game
+ * @param filename Saved game file
+ * @return Summary, or null if the file could not be read
+ */
+const saved_game_info *game_save_index_get(const char *dir, const char *filename);
+
+/**
+ * Checks all entries against the file system again on their next use
+ */
+void game_save_index_refresh(void);
+
+/**
+ * Forgets the summary of a saved game after it was written or deleted
+ * @param dir Directory of the saved game
+ * @param filename Saved game file
+ */
+void game_save_index_invalidate(const char *dir, const char *filename);
+
+/**
+ * Writes the index to its directory when it changed
+ */
+void game_save_index_save(void);
+
+#endif // GAME_SAVE_INDEX_H
@@ -26,6 +26,7 @@
 #include "city/sentiment.h"
 #include "city/trade.h"
 #include "city/victory.h"
+#include "core/config.h"
 #include "core/file.h"
 #include "core/random.h"
 #include "editor/editor.h"
@@ -97,7 +98,10 @@ static void advance_month(void)
     city_population_record_monthly();
     city_festival_update();
     if (setting_monthly_autosave()) {
-        game_file_io_write_saved_game(SAVES_DIR_PATH, "autosave.sav");
+        game_file_io_write_saved_game_in_background(SAVES_DIR_PATH, "autosave.sav");
+    }
+    if (config_get(CONFIG_GAME_MONTHLY_SNAPSHOTS)) {
+        game_file_io_take_snapshot();
     }
 }
 
@@ -1,6 +1,7 @@
 #include "font.h"
 
 #include "core/image.h"
+#include "graphics/image.h"
 
 static int image_y_offset_default(uint8_t c, int image_height, int line_height);
 
@@ -58,12 +59,30 @@ static int image_y_offset_default(uint8_t c, int image_height, int line_height)
     return offset;
 }
 
+static int num_font_letters(void)
+{
+    int max_mapping = 0;
+    for (int i = 0; i < 256; i++) {
+        if (data.font_mapping[i] > max_mapping) {
+            max_mapping = data.font_mapping[i];
+        }
+    }
+    int num_letters = 0;
+    for (int i = 0; i < FONT_TYPES_MAX; i++) {
+        int font_letters = data.font_definitions[i].image_offset + max_mapping;
+        if (font_letters > num_letters) {
+            num_letters = font_letters;
+        }
+    }
+    return num_letters;
+}
+
 void font_set_encoding(void)
 {
     data.multibyte = MULTIBYTE_NONE;
     data.font_mapping = CHAR_TO_FONT_IMAGE_DEFAULT;
     data.font_definitions = DEFINITIONS_DEFAULT;
-
+    image_build_letter_atlas(num_font_letters(), 0);
 }
 
 const font_definition *font_definition_for(font_t font)
@@ -2,6 +2,7 @@
 
 #include "game/system.h"
 #include "graphics/screen.h"
+#include "platform/thread.h"
 
 #include <stdlib.h>
 #include <string.h>
@@ -12,7 +13,8 @@ static struct {
     int height;
 } canvas;
 
-static struct {
+// Clipping is per thread so the city can be drawn in bands on the worker pool
+static THREAD_LOCAL struct {
     int x_start;
     int x_end;
     int y_start;
@@ -24,7 +26,7 @@ static struct {
     int y;
 } translation;
 
-static clip_info clip;
+static THREAD_LOCAL clip_info clip;
 
 void graphics_init_canvas(int width, int height)
 {
@@ -4,6 +4,7 @@
 #include "graphics/graphics.h"
 #include "graphics/screen.h"
 
+#include <stdlib.h>
 #include <string.h>
 
 #define FOOTPRINT_WIDTH 58
@@ -13,6 +14,11 @@
 #define MIX_RB(src, dst, alpha) ((((src & 0xff00ff) * alpha + (dst & 0xff00ff) * (256 - alpha)) >> 8) & 0xff00ff)
 #define MIX_G(src, dst, alpha) ((((src & 0x00ff00) * alpha + (dst & 0x00ff00) * (256 - alpha)) >> 8) & 0x00ff00)
 
+#define LETTER_PIXEL_PLAIN 1
+#define LETTER_PIXEL_TINTED 2
+#define LETTER_BATCH_SIZE 64
+#define MIN_ATLAS_PIXELS 16384
+
 typedef enum {
     DRAW_TYPE_SET,
     DRAW_TYPE_AND,
@@ -96,15 +102,52 @@ static void draw_uncompressed(
     }
 }
 
+static const color_t *skip_clipped_rows(const image *img, const color_t *data, int height, int rows)
+{
+    if (rows <= 0) {
+        return data;
+    }
+    const int *offsets = image_compressed_row_offsets(img, data, height);
+    if (offsets) {
+        return &data[offsets[rows]];
+    }
+    for (int y = 0; y < rows; y++) {
+        int x = 0;
+        while (x < img->width) {
+            color_t b = *data;
+            data++;
+            if (b == 255) {
+                x += *data;
+                data++;
+            } else {
+                data += b;
+                x += b;
+            }
+        }
+    }
+    return data;
+}
+
+// Returns the number of pixels of the run [x, x + length) that fall within [min_x, max_x)
+static inline int visible_run(int x, int length, int min_x, int max_x, int *visible_x)
+{
+    int start = x < min_x ? min_x : x;
+    int end = x + length > max_x ? max_x : x + length;
+    *visible_x = start;
+    return end - start;
+}
+
 static void draw_compressed(const image *img, const color_t *data, int x_offset, int y_offset, int height)
 {
     const clip_info *clip = graphics_get_clip_info(x_offset, y_offset, img->width, height);
     if (!clip->is_visible) {
         return;
     }
-    int unclipped = clip->clip_x == CLIP_NONE;
+    int min_x = clip->clipped_pixels_left;
+    int max_x = img->width - clip->clipped_pixels_right;
+    data = skip_clipped_rows(img, data, height, clip->clipped_pixels_top);
 
-    for (int y = 0; y < height - clip->clipped_pixels_bottom; y++) {
+    for (int y = clip->clipped_pixels_top; y < height - clip->clipped_pixels_bottom; y++) {
         int x = 0;
         while (x < img->width) {
             color_t b = *data;
@@ -113,28 +156,16 @@ static void draw_compressed(const image *img, const color_t *data, int x_offset,
                 // transparent pixels to skip
                 x += *data;
                 data++;
-            } else if (y < clip->clipped_pixels_top) {
-                data += b;
-                x += b;
             } else {
                 // number of concrete pixels
-                const color_t *pixels = data;
-                data += b;
-                color_t *dst = graphics_get_pixel(x_offset + x, y_offset + y);
-                if (unclipped) {
-                    x += b;
-                    memcpy(dst, pixels, b * sizeof(color_t));
-                } else {
-                    while (b) {
-                        if (x >= clip->clipped_pixels_left && x < img->width - clip->clipped_pixels_right) {
-                            *dst = *pixels;
-                        }
-                        dst++;
-                        x++;
-                        pixels++;
-                        b--;
-                    }
+                int visible_x;
+                int visible = visible_run(x, b, min_x, max_x, &visible_x);
+                if (visible > 0) {
+                    memcpy(graphics_get_pixel(x_offset + visible_x, y_offset + y),
+                        &data[visible_x - x], visible * sizeof(color_t));
                 }
+                data += b;
+                x += b;
             }
         }
     }
@@ -147,9 +178,11 @@ static void draw_compressed_set(
     if (!clip->is_visible) {
         return;
     }
-    int unclipped = clip->clip_x == CLIP_NONE;
+    int min_x = clip->clipped_pixels_left;
+    int max_x = img->width - clip->clipped_pixels_right;
+    data = skip_clipped_rows(img, data, height, clip->clipped_pixels_top);
 
-    for (int y = 0; y < height - clip->clipped_pixels_bottom; y++) {
+    for (int y = clip->clipped_pixels_top; y < height - clip->clipped_pixels_bottom; y++) {
         int x = 0;
         while (x < img->width) {
             color_t b = *data;
@@ -158,29 +191,17 @@ static void draw_compressed_set(
                 // transparent pixels to skip
                 x += *data;
                 data++;
-            } else if (y < clip->clipped_pixels_top) {
-                data += b;
-                x += b;
             } else {
-                data += b;
-                color_t *dst = graphics_get_pixel(x_offset + x, y_offset + y);
-                if (unclipped) {
-                    x += b;
-                    while (b) {
-                        *dst = color;
-                        dst++;
-                        b--;
-                    }
-                } else {
-                    while (b) {
-                        if (x >= clip->clipped_pixels_left && x < img->width - clip->clipped_pixels_right) {
-                            *dst = color;
-                        }
-                        dst++;
-                        x++;
-                        b--;
-                    }
+                int visible_x;
+                int visible = visible_run(x, b, min_x, max_x, &visible_x);
+                color_t *dst = graphics_get_pixel(x_offset + visible_x, y_offset + y);
+                while (visible > 0) {
+                    *dst = color;
+                    dst++;
+                    visible--;
                 }
+                data += b;
+                x += b;
             }
         }
     }
@@ -193,9 +214,11 @@ static void draw_compressed_and(
     if (!clip->is_visible) {
         return;
     }
-    int unclipped = clip->clip_x == CLIP_NONE;
+    int min_x = clip->clipped_pixels_left;
+    int max_x = img->width - clip->clipped_pixels_right;
+    data = skip_clipped_rows(img, data, height, clip->clipped_pixels_top);
 
-    for (int y = 0; y < height - clip->clipped_pixels_bottom; y++) {
+    for (int y = clip->clipped_pixels_top; y < height - clip->clipped_pixels_bottom; y++) {
         int x = 0;
         while (x < img->width) {
             color_t b = *data;
@@ -204,33 +227,20 @@ static void draw_compressed_and(
                 // transparent pixels to skip
                 x += *data;
                 data++;
-            } else if (y < clip->clipped_pixels_top) {
-                data += b;
-                x += b;
             } else {
                 // number of concrete pixels
-                const color_t *pixels = data;
-                data += b;
-                color_t *dst = graphics_get_pixel(x_offset + x, y_offset + y);
-                if (unclipped) {
-                    x += b;
-                    while (b) {
-                        *dst = *pixels & color;
-                        dst++;
-                        pixels++;
-                        b--;
-                    }
-                } else {
-                    while (b) {
-                        if (x >= clip->clipped_pixels_left && x < img->width - clip->clipped_pixels_right) {
-                            *dst = *pixels & color;
-                        }
-                        dst++;
-                        x++;
-                        pixels++;
-                        b--;
-                    }
+                int visible_x;
+                int visible = visible_run(x, b, min_x, max_x, &visible_x);
+                const color_t *pixels = &data[visible_x - x];
+                color_t *dst = graphics_get_pixel(x_offset + visible_x, y_offset + y);
+                while (visible > 0) {
+                    *dst = *pixels & color;
+                    dst++;
+                    pixels++;
+                    visible--;
                 }
+                data += b;
+                x += b;
             }
         }
     }
@@ -243,9 +253,11 @@ static void draw_compressed_blend(
     if (!clip->is_visible) {
         return;
     }
-    int unclipped = clip->clip_x == CLIP_NONE;
+    int min_x = clip->clipped_pixels_left;
+    int max_x = img->width - clip->clipped_pixels_right;
+    data = skip_clipped_rows(img, data, height, clip->clipped_pixels_top);
 
-    for (int y = 0; y < height - clip->clipped_pixels_bottom; y++) {
+    for (int y = clip->clipped_pixels_top; y < height - clip->clipped_pixels_bottom; y++) {
         int x = 0;
         while (x < img->width) {
             color_t b = *data;
@@ -254,29 +266,17 @@ static void draw_compressed_blend(
                 // transparent pixels to skip
                 x += *data;
                 data++;
-            } else if (y < clip->clipped_pixels_top) {
-                data += b;
-                x += b;
             } else {
-                data += b;
-                color_t *dst = graphics_get_pixel(x_offset + x, y_offset + y);
-                if (unclipped) {
-                    x += b;
-                    while (b) {
-                        *dst &= color;
-                        dst++;
-                        b--;
-                    }
-                } else {
-                    while (b) {
-                        if (x >= clip->clipped_pixels_left && x < img->width - clip->clipped_pixels_right) {
-                            *dst &= color;
-                        }
-                        dst++;
-                        x++;
-                        b--;
-                    }
+                int visible_x;
+                int visible = visible_run(x, b, min_x, max_x, &visible_x);
+                color_t *dst = graphics_get_pixel(x_offset + visible_x, y_offset + y);
+                while (visible > 0) {
+                    *dst &= color;
+                    dst++;
+                    visible--;
                 }
+                data += b;
+                x += b;
             }
         }
     }
@@ -300,46 +300,32 @@ static void draw_compressed_blend_alpha(
     color_t alpha_dst = 256 - alpha;
     color_t src_rb = (color & 0xff00ff) * alpha;
     color_t src_g = (color & 0x00ff00) * alpha;
-    int unclipped = clip->clip_x == CLIP_NONE;
+    int min_x = clip->clipped_pixels_left;
+    int max_x = img->width - clip->clipped_pixels_right;
+    data = skip_clipped_rows(img, data, height, clip->clipped_pixels_top);
 
-    for (int y = 0; y < height - clip->clipped_pixels_bottom; y++) {
+    for (int y = clip->clipped_pixels_top; y < height - clip->clipped_pixels_bottom; y++) {
         int x = 0;
-        color_t *dst = graphics_get_pixel(x_offset, y_offset + y);
         while (x < img->width) {
             color_t b = *data;
             data++;
             if (b == 255) {
                 // transparent pixels to skip
                 x += *data;
-                dst += *data;
                 data++;
-            } else if (y < clip->clipped_pixels_top) {
-                data += b;
-                x += b;
-                dst += b;
             } else {
-                data += b;
-                if (unclipped) {
-                    x += b;
-                    while (b) {
-                        color_t d = *dst;
-                        *dst = (((src_rb + (d & 0xff00ff) * alpha_dst) & 0xff00ff00) |
-                                ((src_g  + (d & 0x00ff00) * alpha_dst) & 0x00ff0000)) >> 8;
-                        b--;
-                        dst++;
-                    }
-                } else {
-                    while (b) {
-                        if (x >= clip->clipped_pixels_left && x < img->width - clip->clipped_pixels_right) {
-                            color_t d = *dst;
-                            *dst = (((src_rb + (d & 0xff00ff) * alpha_dst) & 0xff00ff00) |
-                                   ((src_g  + (d & 0x00ff00) * alpha_dst) & 0x00ff0000)) >> 8;
-                        }
-                        dst++;
-                        x++;
-                        b--;
-                    }
+                int visible_x;
+                int visible = visible_run(x, b, min_x, max_x, &visible_x);
+                color_t *dst = graphics_get_pixel(x_offset + visible_x, y_offset + y);
+                while (visible > 0) {
+                    color_t d = *dst;
+                    *dst = (((src_rb + (d & 0xff00ff) * alpha_dst) & 0xff00ff00) |
+                            ((src_g  + (d & 0x00ff00) * alpha_dst) & 0x00ff0000)) >> 8;
+                    dst++;
+                    visible--;
                 }
+                data += b;
+                x += b;
             }
         }
     }
@@ -645,6 +631,34 @@ void image_draw_blend_alpha(int image_id, int x, int y, color_t color)
     }
 }
 
+typedef struct {
+    int is_decoded;
+    int width;
+    int height;
+    int offset;
+} atlas_letter;
+
+typedef struct {
+    atlas_letter *letters;
+    int num_letters;
+} atlas_letter_table;
+
+/**
+ * Letters decoded once into a per-pixel mask and colour, so drawing a letter is a
+ * straight row copy instead of decoding the compressed image every time.
+ * Index 0 holds the normal letters, index 1 the multibyte letters.
+ * The atlas is only built on the main thread and is read-only while drawing,
+ * so the city bands can draw text concurrently.
+ */
+static struct {
+    int generation;
+    atlas_letter_table tables[2];
+    uint8_t *masks;
+    color_t *pixels;
+    int num_pixels;
+    int max_pixels;
+} atlas;
+
 static void draw_multibyte_letter(font_t font, const image *img, const color_t *data, int x, int y, color_t color)
 {
     switch (font) {
@@ -671,7 +685,8 @@ static void draw_multibyte_letter(font_t font, const image *img, const color_t *
     }
 }
 
-void image_draw_letter(font_t font, int letter_id, int x, int y, color_t color)
+// Used when the letter cannot be put in the atlas
+static void draw_letter_direct(font_t font, int letter_id, int x, int y, color_t color)
 {
     const image *img = image_letter(letter_id);
     const color_t *data = image_data_letter(letter_id);
@@ -695,6 +710,338 @@ void image_draw_letter(font_t font, int letter_id, int x, int y, color_t color)
     }
 }
 
+static int reserve_atlas_pixels(int num_pixels)
+{
+    if (num_pixels > atlas.max_pixels) {
+        int max_pixels = atlas.max_pixels ? atlas.max_pixels : MIN_ATLAS_PIXELS;
+        while (max_pixels < num_pixels) {
+            max_pixels *= 2;
+        }
+        uint8_t *masks = (uint8_t *) realloc(atlas.masks, max_pixels);
+        if (!masks) {
+            log_error("Unable to allocate memory for letter atlas", 0, 0);
+            return 0;
+        }
+        atlas.masks = masks;
+        color_t *pixels = (color_t *) realloc(atlas.pixels, sizeof(color_t) * max_pixels);
+        if (!pixels) {
+            log_error("Unable to allocate memory for letter atlas", 0, 0);
+            return 0;
+        }
+        atlas.pixels = pixels;
+        atlas.max_pixels = max_pixels;
+    }
+    return 1;
+}
+
+static int resize_letter_table(atlas_letter_table *table, int num_letters)
+{
+    free(table->letters);
+    table->letters = 0;
+    table->num_letters = 0;
+    if (num_letters <= 0) {
+        return 1;
+    }
+    table->letters = (atlas_letter *) calloc(num_letters, sizeof(atlas_letter));
+    if (!table->letters) {
+        log_error("Unable to allocate memory for letter atlas", 0, 0);
+        return 0;
+    }
+    table->num_letters = num_letters;
+    return 1;
+}
+
+static void decode_compressed_letter(const image *img, const color_t *data, uint8_t *mask, color_t *pixels)
+{
+    for (int y = 0; y < img->height; y++) {
+        int x = 0;
+        while (x < img->width) {
+            color_t b = *data;
+            data++;
+            if (b == 255) {
+                // transparent pixels to skip
+                x += *data;
+                data++;
+            } else {
+                for (int i = 0; i < (int) b && x + i < img->width; i++) {
+                    mask[x + i] = LETTER_PIXEL_PLAIN | LETTER_PIXEL_TINTED;
+                    pixels[x + i] = data[i];
+                }
+                data += b;
+                x += b;
+            }
+        }
+        mask += img->width;
+        pixels += img->width;
+    }
+}
+
+static void decode_uncompressed_letter(const image *img, const color_t *data, uint8_t *mask, color_t *pixels,
+    int can_be_transparent)
+{
+    int num_pixels = img->width * img->height;
+    for (int i = 0; i < num_pixels; i++) {
+        if (data[i] != COLOR_SG2_TRANSPARENT) {
+            mask[i] = LETTER_PIXEL_PLAIN | LETTER_PIXEL_TINTED;
+        } else {
+            // Without transparency the pixel is still copied when the letter is not tinted
+            mask[i] = can_be_transparent ? 0 : LETTER_PIXEL_PLAIN;
+        }
+        pixels[i] = data[i];
+    }
+}
+
+static void decode_atlas_letter(int letter_id, atlas_letter *letter)
+{
+    const image *img = image_letter(letter_id);
+    int num_pixels = img->width * img->height;
+    if (img->width <= 0 || img->height <= 0 || atlas.num_pixels + num_pixels > atlas.max_pixels) {
+        return;
+    }
+    const color_t *data = image_data_letter(letter_id);
+    if (!data) {
+        return;
+    }
+    int offset = atlas.num_pixels;
+    atlas.num_pixels += num_pixels;
+    uint8_t *mask = &atlas.masks[offset];
+    color_t *pixels = &atlas.pixels[offset];
+    memset(mask, 0, num_pixels);
+    if (letter_id >= IMAGE_FONT_MULTIBYTE_OFFSET) {
+        // Multibyte letters are always drawn as uncompressed alpha images
+        decode_uncompressed_letter(img, data, mask, pixels, 1);
+    } else if (img->draw.is_fully_compressed) {
+        decode_compressed_letter(img, data, mask, pixels);
+    } else {
+        decode_uncompressed_letter(img, data, mask, pixels,
+            img->draw.type == IMAGE_TYPE_WITH_TRANSPARENCY || img->draw.is_external);
+    }
+    letter->width = img->width;
+    letter->height = img->height;
+    letter->offset = offset;
+    letter->is_decoded = 1;
+}
+
+static void build_letter_atlas(void)
+{
+    atlas.generation = image_main_generation();
+    atlas.num_pixels = 0;
+    int total_pixels = 0;
+    for (int t = 0; t < 2; t++) {
+        atlas_letter_table *table = &atlas.tables[t];
+        int first_letter_id = t ? IMAGE_FONT_MULTIBYTE_OFFSET : 0;
+        if (table->letters) {
+            memset(table->letters, 0, sizeof(atlas_letter) * table->num_letters);
+        }
+        for (int i = 0; i < table->num_letters; i++) {
+            const image *img = image_letter(first_letter_id + i);
+            if (img->width > 0 && img->height > 0) {
+                total_pixels += img->width * img->height;
+            }
+        }
+    }
+    if (!reserve_atlas_pixels(total_pixels)) {
+        return;
+    }
+    for (int t = 0; t < 2; t++) {
+        atlas_letter_table *table = &atlas.tables[t];
+        int first_letter_id = t ? IMAGE_FONT_MULTIBYTE_OFFSET : 0;
+        for (int i = 0; i < table->num_letters; i++) {
+            decode_atlas_letter(first_letter_id + i, &table->letters[i]);
+        }
+    }
+}
+
+void image_build_letter_atlas(int num_letters, int num_multibyte_letters)
+{
+    if (!resize_letter_table(&atlas.tables[0], num_letters) ||
+        !resize_letter_table(&atlas.tables[1], num_multibyte_letters)) {
+        resize_letter_table(&atlas.tables[0], 0);
+        resize_letter_table(&atlas.tables[1], 0);
+    }
+    build_letter_atlas();
+}
+
+void image_update_letter_atlas(void)
+{
+    if (atlas.generation != image_main_generation()) {
+        build_letter_atlas();
+    }
+}
+
+static const atlas_letter *get_atlas_letter(int letter_id)
+{
+    if (atlas.generation != image_main_generation()) {
+        // Images were reloaded since the atlas was built: draw directly until it is rebuilt
+        return 0;
+    }
+    int is_multibyte = letter_id >= IMAGE_FONT_MULTIBYTE_OFFSET;
+    const atlas_letter_table *table = &atlas.tables[is_multibyte];
+    int index = is_multibyte ? letter_id - IMAGE_FONT_MULTIBYTE_OFFSET : letter_id;
+    if (index < 0 || index >= table->num_letters || !table->letters[index].is_decoded) {
+        return 0;
+    }
+    return &table->letters[index];
+}
+
+static void draw_letter_row_tinted(color_t *dst, const uint8_t *mask, int width, color_t color)
+{
+    for (int x = 0; x < width; x++) {
+        dst[x] = (mask[x] & LETTER_PIXEL_TINTED) ? color : dst[x];
+    }
+}
+
+static void draw_letter_row_plain(color_t *dst, const uint8_t *mask, const color_t *pixels, int width)
+{
+    for (int x = 0; x < width; x++) {
+        dst[x] = (mask[x] & LETTER_PIXEL_PLAIN) ? pixels[x] : dst[x];
+    }
+}
+
+static void draw_letter_row_blend_alpha(color_t *dst, const uint8_t *mask, const color_t *pixels,
+    int width, color_t color)
+{
+    for (int x = 0; x < width; x++) {
+        if (mask[x] & LETTER_PIXEL_TINTED) {
+            color_t alpha = COMPONENT(pixels[x], 24);
+            if (alpha == 255) {
+                dst[x] = color;
+            } else {
+                color_t d = dst[x];
+                dst[x] = MIX_RB(color, d, alpha) | MIX_G(color, d, alpha);
+            }
+        }
+    }
+}
+
+static void draw_atlas_letter(const atlas_letter *letter, int x, int y, color_t color, draw_type type,
+    const clip_info *clip)
+{
+    int x_min = clip ? clip->clipped_pixels_left : 0;
+    int x_max = letter->width - (clip ? clip->clipped_pixels_right : 0);
+    int y_min = clip ? clip->clipped_pixels_top : 0;
+    int y_max = letter->height - (clip ? clip->clipped_pixels_bottom : 0);
+    int width = x_max - x_min;
+    for (int row = y_min; row < y_max; row++) {
+        int offset = letter->offset + row * letter->width + x_min;
+        const uint8_t *mask = &atlas.masks[offset];
+        const color_t *pixels = &atlas.pixels[offset];
+        color_t *dst = graphics_get_pixel(x + x_min, y + row);
+        if (type == DRAW_TYPE_BLEND_ALPHA) {
+            draw_letter_row_blend_alpha(dst, mask, pixels, width, color);
+        } else if (type == DRAW_TYPE_SET) {
+            draw_letter_row_tinted(dst, mask, width, color);
+        } else {
+            draw_letter_row_plain(dst, mask, pixels, width);
+        }
+    }
+}
+
+static void draw_atlas_letter_clipped(const atlas_letter *letter, int x, int y, color_t color, draw_type type)
+{
+    const clip_info *clip = graphics_get_clip_info(x, y, letter->width, letter->height);
+    if (clip->is_visible) {
+        draw_atlas_letter(letter, x, y, color, type, clip);
+    }
+}
+
+static void draw_multibyte_atlas_letter(font_t font, const atlas_letter *letter, int x, int y, color_t color)
+{
+    color_t shadow;
+    switch (font) {
+        case FONT_NORMAL_WHITE:
+            shadow = 0x311c10;
+            color = COLOR_WHITE;
+            break;
+        case FONT_NORMAL_RED:
+            shadow = 0xe7cfad;
+            color = 0x731408;
+            break;
+        case FONT_NORMAL_GREEN:
+            shadow = 0xe7cfad;
+            color = 0x180800;
+            break;
+        case FONT_NORMAL_BLACK:
+        case FONT_LARGE_BLACK:
+            shadow = 0xcead9c;
+            color = COLOR_BLACK;
+            break;
+        default: // Plain + brown
+            draw_atlas_letter_clipped(letter, x, y, color, DRAW_TYPE_BLEND_ALPHA);
+            return;
+    }
+    draw_atlas_letter_clipped(letter, x + 1, y + 1, shadow, DRAW_TYPE_BLEND_ALPHA);
+    draw_atlas_letter_clipped(letter, x, y, color, DRAW_TYPE_BLEND_ALPHA);
+}
+
+static void draw_letter_batch(font_t font, const image_letter_position *letters, int num_letters, color_t color)
+{
+    const atlas_letter *decoded[LETTER_BATCH_SIZE];
+    int x_min = 0, y_min = 0, x_max = 0, y_max = 0;
+    int has_bounds = 0;
+    for (int i = 0; i < num_letters; i++) {
+        decoded[i] = get_atlas_letter(letters[i].letter_id);
+        if (!decoded[i]) {
+            continue;
+        }
+        // Multibyte shadows reach one pixel further
+        int extra = letters[i].letter_id >= IMAGE_FONT_MULTIBYTE_OFFSET ? 1 : 0;
+        int right = letters[i].x + decoded[i]->width + extra;
+        int bottom = letters[i].y + decoded[i]->height + extra;
+        if (!has_bounds) {
+            x_min = letters[i].x;
+            y_min = letters[i].y;
+            x_max = right;
+            y_max = bottom;
+            has_bounds = 1;
+        } else {
+            x_min = letters[i].x < x_min ? letters[i].x : x_min;
+            y_min = letters[i].y < y_min ? letters[i].y : y_min;
+            x_max = right > x_max ? right : x_max;
+            y_max = bottom > y_max ? bottom : y_max;
+        }
+    }
+    int fully_visible = 0;
+    if (has_bounds) {
+        // Clip the whole run at once: most text is not clipped at all
+        const clip_info *clip = graphics_get_clip_info(x_min, y_min, x_max - x_min, y_max - y_min);
+        if (!clip->is_visible) {
+            return;
+        }
+        fully_visible = !clip->clipped_pixels_left && !clip->clipped_pixels_right &&
+            !clip->clipped_pixels_top && !clip->clipped_pixels_bottom;
+    }
+    draw_type type = color ? DRAW_TYPE_SET : DRAW_TYPE_NONE;
+    for (int i = 0; i < num_letters; i++) {
+        const image_letter_position *letter = &letters[i];
+        if (!decoded[i]) {
+            draw_letter_direct(font, letter->letter_id, letter->x, letter->y, color);
+        } else if (letter->letter_id >= IMAGE_FONT_MULTIBYTE_OFFSET) {
+            draw_multibyte_atlas_letter(font, decoded[i], letter->x, letter->y, color);
+        } else if (fully_visible) {
+            draw_atlas_letter(decoded[i], letter->x, letter->y, color, type, 0);
+        } else {
+            draw_atlas_letter_clipped(decoded[i], letter->x, letter->y, color, type);
+        }
+    }
+}
+
+void image_draw_letters(font_t font, const image_letter_position *letters, int num_letters, color_t color)
+{
+    while (num_letters > 0) {
+        int batch = num_letters < LETTER_BATCH_SIZE ? num_letters : LETTER_BATCH_SIZE;
+        draw_letter_batch(font, letters, batch, color);
+        letters += batch;
+        num_letters -= batch;
+    }
+}
+
+void image_draw_letter(font_t font, int letter_id, int x, int y, color_t color)
+{
+    image_letter_position letter = { letter_id, x, y };
+    draw_letter_batch(font, &letter, 1, color);
+}
+
 void image_draw_fullscreen_background(int image_id)
 {
     int s_width = screen_width();
@@ -5,6 +5,12 @@
 #include "graphics/color.h"
 #include "graphics/font.h"
 
+typedef struct {
+    int letter_id;
+    int x;
+    int y;
+} image_letter_position;
+
 void image_draw(int image_id, int x, int y);
 void image_draw_enemy(int image_id, int x, int y);
 
@@ -12,6 +18,9 @@ void image_draw_masked(int image_id, int x, int y, color_t color_mask);
 void image_draw_blend(int image_id, int x, int y, color_t color);
 void image_draw_blend_alpha(int image_id, int x, int y, color_t color);
 void image_draw_letter(font_t font, int letter_id, int x, int y, color_t color);
+void image_draw_letters(font_t font, const image_letter_position *letters, int num_letters, color_t color);
+void image_build_letter_atlas(int num_letters, int num_multibyte_letters);
+void image_update_letter_atlas(void);
 
 void image_draw_fullscreen_background(int image_id);
 
@@ -3,6 +3,7 @@
 #include "core/calc.h"
 #include "core/image.h"
 #include "core/image_group.h"
+#include "core/log.h"
 #include "core/string.h"
 #include "graphics/image.h"
 #include "graphics/image_button.h"
@@ -10,7 +11,12 @@
 #include "graphics/scrollbar.h"
 #include "graphics/window.h"
 
+#include <stdlib.h>
+#include <string.h>
+
 #define MAX_LINKS 50
+#define MAX_LAYOUTS 8
+#define MAX_GLYPHS_PER_DRAW 64
 
 static void on_scroll(void);
 
@@ -26,6 +32,60 @@ static struct {
 
 static uint8_t tmp_line[200];
 
+typedef struct {
+    font_t font;
+    int letter_id;
+    int x;
+    int y_offset;
+} layout_glyph;
+
+typedef struct {
+    int message_id;
+    int x_start;
+    int x_end;
+} layout_link;
+
+typedef struct {
+    int first_glyph;
+    int num_glyphs;
+    int first_link;
+    int num_links;
+    int image_id; /**< Image drawn from this line, 0 if none */
+} layout_line;
+
+/**
+ * Line breaks and positioned glyphs of a text. The positions are relative to the
+ * x offset of the text so the layout can be drawn anywhere.
+ */
+typedef struct {
+    uint32_t text_hash;
+    int text_length;
+    uint8_t *text;
+    int max_text_length;
+    int box_width;
+    int measure_only;
+    const font_definition *normal_font;
+    const font_definition *link_font;
+    int line_height;
+    unsigned int last_used;
+    int total_lines;
+
+    layout_line *lines;
+    int num_lines;
+    int max_lines;
+    layout_glyph *glyphs;
+    int num_glyphs;
+    int max_glyphs;
+    layout_link *links;
+    int num_links;
+    int max_links;
+} text_layout;
+
+static struct {
+    text_layout layouts[MAX_LAYOUTS];
+    unsigned int use_counter;
+} cache;
+
 static struct {
     const font_definition *normal_font;
     const font_definition *link_font;
@@ -163,8 +223,60 @@ static int get_word_width(const uint8_t *str, int in_link, int *num_chars)
     return width;
 }
 
-static void draw_line(const uint8_t *str, int x, int y, color_t color, int measure_only)
+static int grow_array(void **items, int *max_items, int needed, size_t item_size)
+{
+    if (needed <= *max_items) {
+        return 1;
+    }
+    int max = *max_items ? 2 * *max_items : 64;
+    while (max < needed) {
+        max *= 2;
+    }
+    void *new_items = realloc(*items, max * item_size);
+    if (!new_items) {
+        log_error("Unable to allocate memory for text layout", 0, 0);
+        return 0;
+    }
+    *items = new_items;
+    *max_items = max;
+    return 1;
+}
+
+static int add_layout_glyph(text_layout *layout, font_t font, int letter_id, int x, int y_offset)
 {
+    if (!grow_array((void **) &layout->glyphs, &layout->max_glyphs, layout->num_glyphs + 1, sizeof(layout_glyph))) {
+        return 0;
+    }
+    layout_glyph *glyph = &layout->glyphs[layout->num_glyphs++];
+    glyph->font = font;
+    glyph->letter_id = letter_id;
+    glyph->x = x;
+    glyph->y_offset = y_offset;
+    return 1;
+}
+
+static int add_layout_link(text_layout *layout, int message_id, int x_start, int x_end)
+{
+    if (!grow_array((void **) &layout->links, &layout->max_links, layout->num_links + 1, sizeof(layout_link))) {
+        return 0;
+    }
+    layout_link *link = &layout->links[layout->num_links++];
+    link->message_id = message_id;
+    link->x_start = x_start;
+    link->x_end = x_end;
+    return 1;
+}
+
+static int layout_line_glyphs(text_layout *layout, const uint8_t *str, int x)
+{
+    if (!grow_array((void **) &layout->lines, &layout->max_lines, layout->num_lines + 1, sizeof(layout_line))) {
+        return 0;
+    }
+    layout_line *line = &layout->lines[layout->num_lines++];
+    line->first_glyph = layout->num_glyphs;
+    line->first_link = layout->num_links;
+    line->image_id = 0;
+
     int start_link = 0;
     int num_link_chars = 0;
     while (*str) {
@@ -174,7 +286,9 @@ static void draw_line(const uint8_t *str, int x, int y, color_t color, int measu
                 str++;
             }
             int width = get_word_width(str, 1, &num_link_chars);
-            add_link(message_id, x, x + width, y);
+            if (!add_layout_link(layout, message_id, x, x + width)) {
+                return 0;
+            }
             start_link = 1;
         }
         if (*str >= ' ') {
@@ -194,9 +308,9 @@ static void draw_line(const uint8_t *str, int x, int y, color_t color, int measu
                     start_link = 0;
                 }
                 const image *img = image_letter(letter_id);
-                if (!measure_only) {
-                    int height = def->image_y_offset(*str, img->height, def->line_height);
-                    image_draw_letter(def->font, letter_id, x, y - height, color);
+                int height = def->image_y_offset(*str, img->height, def->line_height);
+                if (!add_layout_glyph(layout, def->font, letter_id, x, height)) {
+                    return 0;
                 }
                 x += img->width + def->letter_spacing;
             }
@@ -208,17 +322,18 @@ static void draw_line(const uint8_t *str, int x, int y, color_t color, int measu
             str++;
         }
     }
+    line->num_glyphs = layout->num_glyphs - line->first_glyph;
+    line->num_links = layout->num_links - line->first_link;
+    return 1;
 }
 
-static int draw_text(const uint8_t *text, int x_offset, int y_offset,
-                     int box_width, int height_lines, color_t color, int measure_only)
+static int layout_text(text_layout *layout, const uint8_t *text, int box_width, int measure_only)
 {
     int image_height_lines = 0;
     int image_id = 0;
     int lines_before_image = 0;
     int paragraph = 0;
     int has_more_characters = 1;
-    int y = y_offset;
     int guard = 0;
     int line = 0;
     int num_lines = 0;
@@ -287,42 +402,147 @@ static int draw_text(const uint8_t *text, int x_offset, int y_offset,
             }
         }
 
-        int outside_viewport = 0;
-        if (!measure_only) {
-            if (line < scrollbar.scroll_position || line >= scrollbar.scroll_position + height_lines) {
-                outside_viewport = 1;
-            }
-        }
-        if (!outside_viewport) {
-            draw_line(tmp_line, x_line_offset + x_offset, y, color, measure_only);
+        if (!layout_line_glyphs(layout, tmp_line, x_line_offset)) {
+            return 0;
         }
         if (!measure_only) {
             if (image_id) {
                 if (lines_before_image) {
                     lines_before_image--;
                 } else {
-                    const image *img = image_get(image_id);
-                    image_height_lines = img->height / data.line_height + 2;
-                    int image_offset_x = x_offset + (box_width - img->width) / 2 - 4;
-                    if (line < height_lines + scrollbar.scroll_position) {
-                        if (line >= scrollbar.scroll_position) {
-                            image_draw(image_id, image_offset_x, y + 8);
-                        } else {
-                            image_draw(image_id, image_offset_x,
-                                y + 8 - data.line_height * (scrollbar.scroll_position - line));
-                        }
-                    }
+                    image_height_lines = image_get(image_id)->height / data.line_height + 2;
+                    layout->lines[layout->num_lines - 1].image_id = image_id;
                     image_id = 0;
                 }
             }
         }
         line++;
         num_lines++;
+    }
+    layout->total_lines = num_lines;
+    return 1;
+}
+
+static uint32_t hash_text(const uint8_t *text, int *length)
+{
+    uint32_t hash = 2166136261u;
+    const uint8_t *start = text;
+    while (*text) {
+        hash ^= *text++;
+        hash *= 16777619u;
+    }
+    *length = (int) (text - start);
+    return hash;
+}
+
+static const text_layout *get_layout(const uint8_t *text, int box_width, int measure_only)
+{
+    int length;
+    uint32_t hash = hash_text(text, &length);
+    text_layout *layout = 0;
+    for (int i = 0; i < MAX_LAYOUTS; i++) {
+        text_layout *candidate = &cache.layouts[i];
+        if (candidate->last_used && candidate->text_hash == hash && candidate->text_length == length &&
+            candidate->box_width == box_width && candidate->measure_only == measure_only &&
+            candidate->normal_font == data.normal_font && candidate->link_font == data.link_font &&
+            candidate->line_height == data.line_height && memcmp(candidate->text, text, length) == 0) {
+            candidate->last_used = ++cache.use_counter;
+            return candidate;
+        }
+        if (!layout || candidate->last_used < layout->last_used) {
+            layout = candidate;
+        }
+    }
+    // Replace the least recently used layout, keeping its memory
+    layout->num_lines = 0;
+    layout->num_glyphs = 0;
+    layout->num_links = 0;
+    if (!layout_text(layout, text, box_width, measure_only)) {
+        layout->last_used = 0;
+        return 0;
+    }
+    // Keep a copy of the text so a hash collision never returns another text's layout
+    if (!grow_array((void **) &layout->text, &layout->max_text_length, length + 1, sizeof(uint8_t))) {
+        layout->last_used = 0;
+        return layout;
+    }
+    memcpy(layout->text, text, length + 1);
+    layout->text_hash = hash;
+    layout->text_length = length;
+    layout->box_width = box_width;
+    layout->measure_only = measure_only;
+    layout->normal_font = data.normal_font;
+    layout->link_font = data.link_font;
+    layout->line_height = data.line_height;
+    layout->last_used = ++cache.use_counter;
+    return layout;
+}
+
+static void draw_layout_line(const text_layout *layout, const layout_line *line,
+                             int x_offset, int y, color_t color, int measure_only)
+{
+    for (int i = 0; i < line->num_links; i++) {
+        const layout_link *link = &layout->links[line->first_link + i];
+        add_link(link->message_id, x_offset + link->x_start, x_offset + link->x_end, y);
+    }
+    if (measure_only) {
+        return;
+    }
+    image_letter_position letters[MAX_GLYPHS_PER_DRAW];
+    int num_letters = 0;
+    font_t font = FONT_NORMAL_BLACK;
+    for (int i = 0; i < line->num_glyphs; i++) {
+        const layout_glyph *glyph = &layout->glyphs[line->first_glyph + i];
+        // Draw runs of the same font together
+        if (num_letters && (glyph->font != font || num_letters == MAX_GLYPHS_PER_DRAW)) {
+            image_draw_letters(font, letters, num_letters, color);
+            num_letters = 0;
+        }
+        font = glyph->font;
+        letters[num_letters].letter_id = glyph->letter_id;
+        letters[num_letters].x = x_offset + glyph->x;
+        letters[num_letters].y = y - glyph->y_offset;
+        num_letters++;
+    }
+    image_draw_letters(font, letters, num_letters, color);
+}
+
+static int draw_text(const uint8_t *text, int x_offset, int y_offset,
+                     int box_width, int height_lines, color_t color, int measure_only)
+{
+    const text_layout *layout = get_layout(text, box_width, measure_only);
+    if (!layout) {
+        return 0;
+    }
+    int y = y_offset;
+    for (int line = 0; line < layout->num_lines; line++) {
+        const layout_line *current = &layout->lines[line];
+        int outside_viewport = 0;
+        if (!measure_only) {
+            if (line < scrollbar.scroll_position || line >= scrollbar.scroll_position + height_lines) {
+                outside_viewport = 1;
+            }
+        }
+        if (!outside_viewport) {
+            draw_layout_line(layout, current, x_offset, y, color, measure_only);
+        }
+        if (current->image_id) {
+            const image *img = image_get(current->image_id);
+            int image_offset_x = x_offset + (box_width - img->width) / 2 - 4;
+            if (line < height_lines + scrollbar.scroll_position) {
+                if (line >= scrollbar.scroll_position) {
+                    image_draw(current->image_id, image_offset_x, y + 8);
+                } else {
+                    image_draw(current->image_id, image_offset_x,
+                        y + 8 - data.line_height * (scrollbar.scroll_position - line));
+                }
+            }
+        }
         if (!outside_viewport) {
             y += data.line_height;
         }
     }
-    return num_lines;
+    return layout->total_lines;
 }
 
 int rich_text_draw(const uint8_t *text, int x_offset, int y_offset, int box_width, int height_lines, int measure_only)
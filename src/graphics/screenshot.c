@@ -4,6 +4,7 @@
 #include "city/warning.h"
 #include "core/buffer.h"
 #include "core/config.h"
+#include "core/dir.h"
 #include "core/file.h"
 #include "core/log.h"
 #include "core/string.h"
@@ -110,6 +111,7 @@ static int image_begin_io(const char *filename)
     if (!fp) {
         return 0;
     }
+    dir_invalidate_cache();
     image.fp = fp;
     png_init_io(image.png_ptr, fp);
     return 1;
@@ -10,6 +10,7 @@
 
 #define ELLIPSIS_LENGTH 4
 #define NUMBER_BUFFER_LENGTH 100
+#define MAX_LETTERS_PER_DRAW 64
 
 static uint8_t tmp_line[200];
 
@@ -258,6 +259,8 @@ int text_draw(const uint8_t *str, int x, int y, font_t font, color_t color)
         length = input_cursor.text_offset_end - input_cursor.text_offset_start;
     }
 
+    image_letter_position letters[MAX_LETTERS_PER_DRAW];
+    int num_letters = 0;
     int current_x = x;
     while (length > 0) {
         int num_bytes = 1;
@@ -270,7 +273,14 @@ int text_draw(const uint8_t *str, int x, int y, font_t font, color_t color)
             } else {
                 const image *img = image_letter(letter_id);
                 int height = def->image_y_offset(*str, img->height, def->line_height);
-                image_draw_letter(def->font, letter_id, current_x, y - height, color);
+                if (num_letters == MAX_LETTERS_PER_DRAW) {
+                    image_draw_letters(def->font, letters, num_letters, color);
+                    num_letters = 0;
+                }
+                letters[num_letters].letter_id = letter_id;
+                letters[num_letters].x = current_x;
+                letters[num_letters].y = y - height;
+                num_letters++;
                 width = def->letter_spacing + img->width;
             }
             if (input_cursor.capture && input_cursor.position == input_cursor.cursor_position) {
@@ -287,6 +297,7 @@ int text_draw(const uint8_t *str, int x, int y, font_t font, color_t color)
         length -= num_bytes;
         input_cursor.position += num_bytes;
     }
+    image_draw_letters(def->font, letters, num_letters, color);
     if (input_cursor.capture && !input_cursor.seen) {
         input_cursor.width = 4;
         input_cursor.x_offset = current_x - x;
@@ -1,16 +1,20 @@
 #include "video.h"
 
-#include "core/dir.h"
-#include "core/file.h"
+#include "core/log.h"
 #include "core/smacker.h"
 #include "core/time.h"
 #include "game/settings.h"
 #include "graphics/graphics.h"
 #include "graphics/screen.h"
+#include "platform/platform.h"
 #include "sound/device.h"
 #include "sound/music.h"
 #include "sound/speech.h"
 
+#include <string.h>
+
+#define PALETTE_SIZE 256
+
 static struct {
     int is_playing;
     int is_ended;
@@ -30,13 +34,30 @@ static struct {
         int channels;
         int rate;
     } audio;
+    struct {
+        int frames_drawn;
+        int frames_dropped;
+        int last_draw_micros;
+        uint64_t total_draw_micros;
+    } stats;
 
     int restart_music;
 } data;
 
+static void log_stats(void)
+{
+    if (data.stats.frames_drawn) {
+        log_info("SMK: frames drawn", 0, data.stats.frames_drawn);
+        log_info("SMK: frames dropped", 0, data.stats.frames_dropped);
+        log_info("SMK: average draw time in microseconds", 0,
+            (int) (data.stats.total_draw_micros / data.stats.frames_drawn));
+    }
+}
+
 static void close_smk(void)
 {
     if (data.s) {
+        log_stats();
         smacker_close(data.s);
         data.s = 0;
     }
@@ -44,14 +65,8 @@ static void close_smk(void)
 
 static int load_smk(const char *filename)
 {
-    const char *path = get_case_corrected_file(0, filename);
-    if (!path) {
-        return 0;
-    }
-    FILE *fp = file_open(path, "rb");
-    data.s = smacker_open(fp);
+    data.s = smacker_open(filename);
     if (!data.s) {
-        // smacker_open() closes the stream on error: no need to close fp
         return 0;
     }
 
@@ -64,6 +79,7 @@ static int load_smk(const char *filename)
     data.video.y_scale = y_scale;
     data.video.current_frame = 0;
     data.video.micros_per_frame = micros_per_frame;
+    memset(&data.stats, 0, sizeof(data.stats));
 
     data.audio.has_audio = 0;
     if (setting_sound(SOUND_EFFECTS)->enabled) {
@@ -81,6 +97,9 @@ static int load_smk(const char *filename)
         close_smk();
         return 0;
     }
+    if (!smacker_start_decoder(data.s)) {
+        log_info("SMK: decoding frames on demand", filename, 0);
+    }
     return 1;
 }
 
@@ -171,6 +190,10 @@ static int get_next_frame(void)
             return 0;
         }
         data.video.current_frame++;
+        if (draw_frame) {
+            // The previous frame was decoded but will never be shown
+            data.stats.frames_dropped++;
+        }
         draw_frame = 1;
 
         if (data.audio.has_audio) {
@@ -183,27 +206,168 @@ static int get_next_frame(void)
     return draw_frame;
 }
 
-void video_draw(int x_offset, int y_offset)
+void video_get_stats(video_stats *stats)
 {
-    if (!get_next_frame()) {
-        return;
+    stats->frames_drawn = data.stats.frames_drawn;
+    stats->frames_dropped = data.stats.frames_dropped;
+    stats->last_draw_micros = data.stats.last_draw_micros;
+    stats->average_draw_micros = data.stats.frames_drawn ?
+        (int) (data.stats.total_draw_micros / data.stats.frames_drawn) : 0;
+}
+
+static void add_draw_time(uint64_t start_micros)
+{
+    data.stats.last_draw_micros = (int) (platform_get_microseconds() - start_micros);
+    data.stats.total_draw_micros += data.stats.last_draw_micros;
+    data.stats.frames_drawn++;
+}
+
+static void expand_palette(color_t *dst, const unsigned char *src, int count, const color_t *pal)
+{
+    // Unrolled so the compiler can turn the lookups into gathers where the target has them
+    int x = 0;
+    for (; x + 8 <= count; x += 8) {
+        dst[x] = pal[src[x]];
+        dst[x + 1] = pal[src[x + 1]];
+        dst[x + 2] = pal[src[x + 2]];
+        dst[x + 3] = pal[src[x + 3]];
+        dst[x + 4] = pal[src[x + 4]];
+        dst[x + 5] = pal[src[x + 5]];
+        dst[x + 6] = pal[src[x + 6]];
+        dst[x + 7] = pal[src[x + 7]];
     }
-    const clip_info *clip = graphics_get_clip_info(x_offset, y_offset, data.video.width, data.video.height);
+    for (; x < count; x++) {
+        dst[x] = pal[src[x]];
+    }
+}
+
+static void expand_palette_2x(color_t *dst, const unsigned char *src, int count, const color_t *pal)
+{
+    for (int x = 0; x < count; x++) {
+        color_t color = pal[src[x]];
+        dst[0] = color;
+        dst[1] = color;
+        dst += 2;
+    }
+}
+
+static void expand_palette_3x(color_t *dst, const unsigned char *src, int count, const color_t *pal)
+{
+    for (int x = 0; x < count; x++) {
+        color_t color = pal[src[x]];
+        dst[0] = color;
+        dst[1] = color;
+        dst[2] = color;
+        dst += 3;
+    }
+}
+
+/**
+ * Draws the screen pixels x_start to x_end of a video line enlarged by an integer scale
+ */
+static void draw_scaled_line(color_t *dst, const unsigned char *line, int x_start, int x_end, int scale,
+    const color_t *pal)
+{
+    int x = x_start;
+    while (x < x_end && x % scale) {
+        *dst++ = pal[line[x / scale]];
+        x++;
+    }
+    int count = (x_end - x) / scale;
+    const unsigned char *src = &line[x / scale];
+    switch (scale) {
+        case 1:
+            expand_palette(dst, src, count, pal);
+            break;
+        case 2:
+            expand_palette_2x(dst, src, count, pal);
+            break;
+        case 3:
+            expand_palette_3x(dst, src, count, pal);
+            break;
+        default:
+            for (int i = 0; i < count; i++) {
+                color_t color = pal[src[i]];
+                for (int j = 0; j < scale; j++) {
+                    dst[i * scale + j] = color;
+                }
+            }
+            break;
+    }
+    dst += count * scale;
+    x += count * scale;
+    while (x < x_end) {
+        *dst++ = pal[line[x / scale]];
+        x++;
+    }
+}
+
+/**
+ * Draws the video at an integer scale, converting each video line only once
+ */
+static void draw_scaled(const unsigned char *frame, const color_t *pal, int x_offset, int y_offset, int scale)
+{
+    int video_width = data.video.width * scale;
+    int video_height = data.video.height * scale;
+    const clip_info *clip = graphics_get_clip_info(x_offset, y_offset, video_width, video_height);
     if (!clip->is_visible) {
         return;
     }
+    int x_start = clip->clipped_pixels_left;
+    int x_end = video_width - clip->clipped_pixels_right;
+    int y_end = video_height - clip->clipped_pixels_bottom;
+    int rows_per_line = data.video.y_scale == SMACKER_Y_SCALE_NONE ? scale : 2 * scale;
+    const color_t *converted_row = 0;
+    int converted_line = -1;
+    for (int y = clip->clipped_pixels_top; y < y_end; y++) {
+        color_t *pixel = graphics_get_pixel(x_offset + x_start, y_offset + y);
+        int video_y = y / rows_per_line;
+        if (video_y == converted_line) {
+            memcpy(pixel, converted_row, sizeof(color_t) * (x_end - x_start));
+        } else {
+            draw_scaled_line(pixel, frame + video_y * data.video.width, x_start, x_end, scale, pal);
+            converted_row = pixel;
+            converted_line = video_y;
+        }
+    }
+}
+
+void video_draw(int x_offset, int y_offset)
+{
+    if (!get_next_frame()) {
+        return;
+    }
     const unsigned char *frame = smacker_get_frame_video(data.s);
     const uint32_t *pal = smacker_get_frame_palette(data.s);
     if (frame && pal) {
-        for (int y = clip->clipped_pixels_top; y < clip->visible_pixels_y; y++) {
-            color_t *pixel = graphics_get_pixel(
-                x_offset + clip->clipped_pixels_left, y + y_offset + clip->clipped_pixels_top);
-            int video_y = data.video.y_scale == SMACKER_Y_SCALE_NONE ? y : y / 2;
-            const unsigned char *line = frame + (video_y * data.video.width);
-            for (int x = clip->clipped_pixels_left; x < clip->visible_pixels_x; x++) {
-                *pixel = pal[line[x]];
-                ++pixel;
-            }
+        uint64_t start_micros = platform_get_microseconds();
+        draw_scaled(frame, pal, x_offset, y_offset, 1);
+        add_draw_time(start_micros);
+    }
+}
+
+static void draw_downscaled(const unsigned char *frame, const color_t *pal, int s_width, int s_height)
+{
+    double scale_w = s_width / (double) data.video.width;
+    double scale_h = s_height / (double) data.video.height;
+    double scale = scale_w < scale_h ? scale_w : scale_h;
+    int video_width = (int) (scale * data.video.width);
+    int video_height = (int) (scale * data.video.height);
+    int x_offset = (s_width - video_width) / 2;
+    int y_offset = (s_height - video_height) / 2;
+    const clip_info *clip = graphics_get_clip_info(x_offset, y_offset, video_width, video_height);
+    if (!clip->is_visible) {
+        return;
+    }
+    int source_height = data.video.y_scale == SMACKER_Y_SCALE_NONE ? data.video.height : data.video.height / 2;
+    for (int y = clip->clipped_pixels_top; y < video_height - clip->clipped_pixels_bottom; y++) {
+        color_t *pixel = graphics_get_pixel(x_offset + clip->clipped_pixels_left, y_offset + y);
+        int x_max = video_width - clip->clipped_pixels_right;
+        int video_y = (int) (y / scale) * source_height / data.video.height;
+        const unsigned char *line = frame + (video_y * data.video.width);
+        for (int x = clip->clipped_pixels_left; x < x_max; x++) {
+            *pixel = pal[line[(int) (x / scale)]];
+            ++pixel;
         }
     }
 }
@@ -213,31 +377,27 @@ void video_draw_fullscreen(void)
     if (!get_next_frame()) {
         return;
     }
+    const unsigned char *frame = smacker_get_frame_video(data.s);
+    const uint32_t *frame_pal = smacker_get_frame_palette(data.s);
+    if (!frame || !frame_pal) {
+        return;
+    }
+    uint64_t start_micros = platform_get_microseconds();
+    color_t pal[PALETTE_SIZE];
+    for (int i = 0; i < PALETTE_SIZE; i++) {
+        pal[i] = ALPHA_OPAQUE | frame_pal[i];
+    }
     int s_width = screen_width();
     int s_height = screen_height();
-    const unsigned char *frame = smacker_get_frame_video(data.s);
-    const uint32_t *pal = smacker_get_frame_palette(data.s);
-    if (frame && pal) {
-        double scale_w = s_width / (double) data.video.width;
-        double scale_h = s_height / (double) data.video.height * (data.video.y_scale == SMACKER_Y_SCALE_NONE ? 1 : 2);
-        double scale = scale_w < scale_h ? scale_w : scale_h;
-        int video_width = (int) (scale * data.video.width);
-        int video_height = (int) (scale * data.video.height);
-        int x_offset = (s_width - video_width) / 2;
-        int y_offset = (s_height - video_height) / 2;
-        const clip_info *clip = graphics_get_clip_info(x_offset, y_offset, video_width, video_height);
-        if (!clip->is_visible) {
-            return;
-        }
-        for (int y = clip->clipped_pixels_top; y < video_height - clip->clipped_pixels_bottom; y++) {
-            color_t *pixel = graphics_get_pixel(x_offset + clip->clipped_pixels_left, y_offset + y);
-            int x_max = video_width - clip->clipped_pixels_right;
-            int video_y = (int) ((data.video.y_scale == SMACKER_Y_SCALE_NONE ? y : y / 2) / scale);
-            const unsigned char *line = frame + (video_y * data.video.width);
-            for (int x = clip->clipped_pixels_left; x < x_max; x++) {
-                *pixel = ALPHA_OPAQUE | pal[line[(int)(x / scale)]];
-                ++pixel;
-            }
-        }
+    int scale_w = s_width / data.video.width;
+    int scale_h = s_height / data.video.height;
+    int scale = scale_w < scale_h ? scale_w : scale_h;
+    if (scale >= 1) {
+        draw_scaled(frame, pal, (s_width - scale * data.video.width) / 2,
+            (s_height - scale * data.video.height) / 2, scale);
+    } else {
+        // Screen is smaller than the video
+        draw_downscaled(frame, pal, s_width, s_height);
     }
+    add_draw_time(start_micros);
 }
@@ -45,8 +45,22 @@ void video_shutdown(void);
 void video_draw(int x_offset, int y_offset);
 
 /**
- * Draws a frame of the current video at fullscreen
+ * Draws a frame of the current video at fullscreen, enlarged by the largest integer
+ * scale that fits the screen
  */
 void video_draw_fullscreen(void);
 
+typedef struct {
+    int frames_drawn; /**< Frames drawn to the screen */
+    int frames_dropped; /**< Frames decoded but skipped to keep up with the video */
+    int last_draw_micros; /**< Time it took to draw the last frame */
+    int average_draw_micros; /**< Average time to draw a frame */
+} video_stats;
+
+/**
+ * Gets the playback statistics of the current video
+ * @param stats Out: statistics
+ */
+void video_get_stats(video_stats *stats);
+
 #endif // GRAPHICS_VIDEO_H
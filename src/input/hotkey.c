@@ -66,6 +66,12 @@ static void set_definition_for_action(hotkey_action action, hotkey_definition *d
         case HOTKEY_SAVE_FILE:
             def->action = &data.hotkey_state.save_file;
             break;
+        case HOTKEY_TAKE_SNAPSHOT:
+            def->action = &data.hotkey_state.take_snapshot;
+            break;
+        case HOTKEY_RESTORE_SNAPSHOT:
+            def->action = &data.hotkey_state.restore_snapshot;
+            break;
         case HOTKEY_DECREASE_GAME_SPEED:
             def->action = &data.hotkey_state.decrease_game_speed;
             def->repeatable = 1;
@@ -11,6 +11,8 @@ typedef struct {
     // keys with specific function
     int load_file;
     int save_file;
+    int take_snapshot;
+    int restore_snapshot;
     int decrease_game_speed;
     int increase_game_speed;
     int toggle_pause;
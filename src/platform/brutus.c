@@ -16,6 +16,7 @@
 #include "platform/keyboard_input.h"
 #include "platform/platform.h"
 #include "platform/screen.h"
+#include "platform/thread.h"
 
 #include "tinyfiledialogs/tinyfiledialogs.h"
 
@@ -306,6 +307,7 @@ static void teardown(void)
 {
     SDL_Log("Exiting game");
     game_exit();
+    platform_thread_shutdown();
     platform_screen_destroy();
     SDL_Quit();
     teardown_logging();
@@ -17,6 +17,7 @@
 #endif
 
 #ifdef _WIN32
+#include <io.h>
 #include <windows.h>
 
 #define fs_dir_type _WDIR
@@ -50,6 +51,8 @@ static wchar_t *utf8_to_wchar(const char *str)
 }
 
 #else // not _WIN32
+#include <sys/mman.h>
+
 #define fs_dir_type DIR
 #define fs_dir_entry struct dirent
 #define fs_dir_open opendir
@@ -196,7 +199,8 @@ FILE *platform_file_manager_open_file(const char *filename, const char *mode)
 
 int platform_file_manager_remove_file(const char *dir, const char *filename)
 {
-    static char filepath_to_remove[2 * FILE_NAME_MAX];
+    // Saves also remove files from a background thread
+    char filepath_to_remove[2 * FILE_NAME_MAX];
     filepath_to_remove[2 * FILE_NAME_MAX - 1] = 0;
 
     if (dir) {
@@ -211,6 +215,51 @@ int platform_file_manager_remove_file(const char *dir, const char *filename)
     return result == 0;
 }
 
+int platform_file_manager_rename_file(const char *from, const char *to)
+{
+    wchar_t *wfrom = utf8_to_wchar(from);
+    wchar_t *wto = utf8_to_wchar(to);
+    int result = MoveFileExW(wfrom, wto, MOVEFILE_REPLACE_EXISTING);
+    free(wfrom);
+    free(wto);
+    return result != 0;
+}
+
+void *platform_file_manager_map_file(FILE *stream, size_t size)
+{
+    HANDLE file = (HANDLE) _get_osfhandle(_fileno(stream));
+    if (file == INVALID_HANDLE_VALUE) {
+        return 0;
+    }
+    HANDLE mapping = CreateFileMapping(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!mapping) {
+        return 0;
+    }
+    void *data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, size);
+    // The view keeps the mapping alive
+    CloseHandle(mapping);
+    return data;
+}
+
+void platform_file_manager_unmap_file(void *data, __attribute__((unused)) size_t size)
+{
+    UnmapViewOfFile(data);
+}
+
+int platform_file_manager_get_file_info(const char *filename, int64_t *modified_time, int64_t *size)
+{
+    wchar_t *wfile = utf8_to_wchar(filename);
+    struct _stat64 file_info;
+    int result = _wstat64(wfile, &file_info);
+    free(wfile);
+    if (result != 0) {
+        return 0;
+    }
+    *modified_time = file_info.st_mtime;
+    *size = file_info.st_size;
+    return 1;
+}
+
 #else
 
 FILE *platform_file_manager_open_file(const char *filename, const char *mode)
@@ -218,9 +267,42 @@ FILE *platform_file_manager_open_file(const char *filename, const char *mode)
     return fopen(filename, mode);
 }
 
-int platform_file_manager_remove_file(const char *filename)
+int platform_file_manager_remove_file(const char *dir, const char *filename)
+{
+    if (!dir) {
+        return remove(filename) == 0;
+    }
+    char filepath_to_remove[2 * FILE_NAME_MAX];
+    filepath_to_remove[2 * FILE_NAME_MAX - 1] = 0;
+    prepend_dir_to_path(dir, filename, filepath_to_remove);
+    return remove(filepath_to_remove) == 0;
+}
+
+int platform_file_manager_rename_file(const char *from, const char *to)
+{
+    return rename(from, to) == 0;
+}
+
+void *platform_file_manager_map_file(FILE *stream, size_t size)
 {
-    return remove(filename) == 0;
+    void *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fileno(stream), 0);
+    return data == MAP_FAILED ? 0 : data;
+}
+
+void platform_file_manager_unmap_file(void *data, size_t size)
+{
+    munmap(data, size);
+}
+
+int platform_file_manager_get_file_info(const char *filename, int64_t *modified_time, int64_t *size)
+{
+    struct stat file_info;
+    if (stat(filename, &file_info) != 0) {
+        return 0;
+    }
+    *modified_time = file_info.st_mtime;
+    *size = file_info.st_size;
+    return 1;
 }
 
 #endif
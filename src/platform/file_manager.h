@@ -1,6 +1,7 @@
 #ifndef PLATFORM_FILE_MANAGER_H
 #define PLATFORM_FILE_MANAGER_H
 
+#include <stdint.h>
 #include <stdio.h>
 
 enum {
@@ -74,6 +75,38 @@ FILE *platform_file_manager_open_file(const char *filename, const char *mode);
  */
 int platform_file_manager_close_file(FILE *stream);
 
+/**
+ * Renames a file, replacing the destination if it exists
+ * @param from Current path of the file
+ * @param to New path of the file
+ * @return true if the file was renamed, false otherwise
+ */
+int platform_file_manager_rename_file(const char *from, const char *to);
+
+/**
+ * Maps an open file into memory for reading
+ * @param stream The open file
+ * @param size Size of the file
+ * @return Pointer to the read-only file contents, or NULL if the file could not be mapped
+ */
+void *platform_file_manager_map_file(FILE *stream, size_t size);
+
+/**
+ * Unmaps a file mapped with platform_file_manager_map_file
+ * @param data Pointer to the mapped contents
+ * @param size Size of the file
+ */
+void platform_file_manager_unmap_file(void *data, size_t size);
+
+/**
+ * Gets the modification time and size of a file
+ * @param filename The file to check
+ * @param modified_time Returns the modification time of the file
+ * @param size Returns the size of the file in bytes
+ * @return true if the file exists, false otherwise
+ */
+int platform_file_manager_get_file_info(const char *filename, int64_t *modified_time, int64_t *size);
+
 /**
  * Removes a file
  * @param dir The directory to look in
@@ -8,3 +8,10 @@ int platform_sdl_version_at_least(int major, int minor, int patch)
     SDL_GetVersion(&v);
     return SDL_VERSIONNUM(v.major, v.minor, v.patch) >= SDL_VERSIONNUM(major, minor, patch);
 }
+
+uint64_t platform_get_microseconds(void)
+{
+    Uint64 counter = SDL_GetPerformanceCounter();
+    Uint64 frequency = SDL_GetPerformanceFrequency();
+    return (counter / frequency) * 1000000 + (counter % frequency) * 1000000 / frequency;
+}
@@ -1,6 +1,14 @@
 #ifndef PLATFORM_PLATFORM_H
 #define PLATFORM_PLATFORM_H
 
+#include <stdint.h>
+
 int platform_sdl_version_at_least(int major, int minor, int patch);
 
+/**
+ * Gets a high resolution timestamp for measuring durations
+ * @return Time in microseconds since an unspecified starting point
+ */
+uint64_t platform_get_microseconds(void);
+
 #endif // PLATFORM_PLATFORM_H
@@ -23,17 +23,35 @@
 #endif
 #define HAS_AUDIOSTREAM() (platform_sdl_version_at_least(2, 0, 7))
 
+#define MAX_CACHED_CHUNKS 256
+#define MAX_CACHE_BYTES (32 * 1024 * 1024)
+
 typedef struct {
     const char *filename;
     Mix_Chunk *chunk;
 } sound_channel;
 
+typedef struct {
+    char filename[FILE_NAME_MAX];
+    Mix_Chunk *chunk;
+    unsigned int last_used;
+} cached_chunk;
+
 static struct {
     int initialized;
     Mix_Music *music;
     sound_channel channels[MAX_CHANNELS];
+    int num_channels;
 } data;
 
+// Chunks are converted to the output format when loaded, so they are kept for the next play
+static struct {
+    cached_chunk entries[MAX_CACHED_CHUNKS];
+    int num_entries;
+    int total_bytes;
+    unsigned int use_counter;
+} cache;
+
 static struct {
     SDL_AudioFormat format;
     SDL_AudioFormat dst_format;
@@ -42,10 +60,17 @@ static struct {
     int use_audiostream;
 #endif
     SDL_AudioCVT cvt;
-    unsigned char *buffer;
-    int buffer_size;
-    int cur_read;
-    int cur_write;
+    Uint8 *scratch;
+    int scratch_size;
+    // Single producer (main thread), single consumer (audio thread) ring buffer
+    struct {
+        Uint8 *data;
+        int size;
+        SDL_atomic_t read;
+        SDL_atomic_t write;
+    } ring;
+    SDL_atomic_t underruns;
+    SDL_atomic_t overruns;
 } custom_music;
 
 static int percentage_to_volume(int percentage)
@@ -56,6 +81,7 @@ static int percentage_to_volume(int percentage)
 static void init_channels(void)
 {
     data.initialized = 1;
+    data.num_channels = 0;
     for (int i = 0; i < MAX_CHANNELS; i++) {
         data.channels[i].chunk = 0;
     }
@@ -100,19 +126,86 @@ void sound_device_close(void)
     if (data.initialized) {
         for (int i = 0; i < MAX_CHANNELS; i++) {
             sound_device_stop_channel(i);
+            data.channels[i].chunk = 0;
+        }
+        for (int i = 0; i < cache.num_entries; i++) {
+            Mix_FreeChunk(cache.entries[i].chunk);
         }
+        cache.num_entries = 0;
+        cache.total_bytes = 0;
         Mix_CloseAudio();
         data.initialized = 0;
     }
 }
 
+static int is_chunk_playing(const Mix_Chunk *chunk)
+{
+    for (int i = 0; i < data.num_channels; i++) {
+        if (data.channels[i].chunk == chunk && Mix_Playing(i)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void evict_cached_chunk(int index)
+{
+    cached_chunk *entry = &cache.entries[index];
+    for (int i = 0; i < data.num_channels; i++) {
+        if (data.channels[i].chunk == entry->chunk) {
+            data.channels[i].chunk = 0;
+        }
+    }
+    cache.total_bytes -= entry->chunk->alen;
+    Mix_FreeChunk(entry->chunk);
+    cache.entries[index] = cache.entries[--cache.num_entries];
+}
+
+static void make_room_in_cache(int bytes)
+{
+    while (cache.num_entries >= MAX_CACHED_CHUNKS ||
+        (cache.num_entries > 0 && cache.total_bytes + bytes > MAX_CACHE_BYTES)) {
+        int oldest = -1;
+        for (int i = 0; i < cache.num_entries; i++) {
+            if ((oldest < 0 || cache.entries[i].last_used < cache.entries[oldest].last_used) &&
+                !is_chunk_playing(cache.entries[i].chunk)) {
+                oldest = i;
+            }
+        }
+        if (oldest < 0) {
+            return;
+        }
+        evict_cached_chunk(oldest);
+    }
+}
+
 static Mix_Chunk *load_chunk(const char *filename)
 {
-    if (filename[0]) {
-        return Mix_LoadWAV(filename);
-    } else {
+    if (!filename[0]) {
+        return NULL;
+    }
+    for (int i = 0; i < cache.num_entries; i++) {
+        if (strcmp(cache.entries[i].filename, filename) == 0) {
+            cache.entries[i].last_used = ++cache.use_counter;
+            return cache.entries[i].chunk;
+        }
+    }
+    Mix_Chunk *chunk = Mix_LoadWAV(filename);
+    if (!chunk) {
         return NULL;
     }
+    // The cache may go over its size while all cached chunks are playing
+    make_room_in_cache(chunk->alen);
+    if (cache.num_entries >= MAX_CACHED_CHUNKS || strlen(filename) >= FILE_NAME_MAX) {
+        Mix_FreeChunk(chunk);
+        return NULL;
+    }
+    cached_chunk *entry = &cache.entries[cache.num_entries++];
+    strcpy(entry->filename, filename);
+    entry->chunk = chunk;
+    entry->last_used = ++cache.use_counter;
+    cache.total_bytes += chunk->alen;
+    return chunk;
 }
 
 static int load_channel(sound_channel *channel)
@@ -130,6 +223,7 @@ void sound_device_init_channels(int num_channels, char filenames[][CHANNEL_FILEN
             num_channels = MAX_CHANNELS;
         }
         Mix_AllocateChannels(num_channels);
+        data.num_channels = num_channels;
         log_info("Loading audio files", 0, 0);
         for (int i = 0; i < num_channels; i++) {
             data.channels[i].chunk = 0;
@@ -150,8 +244,9 @@ void sound_device_set_music_volume(int volume_pct)
 
 void sound_device_set_channel_volume(int channel, int volume_pct)
 {
-    if (data.channels[channel].chunk) {
-        Mix_VolumeChunk(data.channels[channel].chunk, percentage_to_volume(volume_pct));
+    if (data.initialized) {
+        // Set on the channel: cached chunks can be shared between channels
+        Mix_Volume(channel, percentage_to_volume(volume_pct));
     }
 }
 
@@ -229,11 +324,9 @@ void sound_device_stop_music(void)
 void sound_device_stop_channel(int channel)
 {
     if (data.initialized) {
-        sound_channel *ch = &data.channels[channel];
-        if (ch->chunk) {
+        if (data.channels[channel].chunk) {
+            // The chunk stays in the cache for the next play
             Mix_HaltChannel(channel);
-            Mix_FreeChunk(ch->chunk);
-            ch->chunk = 0;
         }
     }
 }
@@ -241,19 +334,31 @@ void sound_device_stop_channel(int channel)
 static void free_custom_audio_stream(void)
 {
 #ifdef USE_SDL_AUDIOSTREAM
-    if (custom_music.use_audiostream) {
-        if (custom_music.stream) {
-            SDL_FreeAudioStream(custom_music.stream);
-            custom_music.stream = 0;
-        }
-        return;
+    if (custom_music.stream) {
+        SDL_FreeAudioStream(custom_music.stream);
+        custom_music.stream = 0;
     }
 #endif
+    free(custom_music.scratch);
+    custom_music.scratch = 0;
+    custom_music.scratch_size = 0;
+    free(custom_music.ring.data);
+    custom_music.ring.data = 0;
+    custom_music.ring.size = 0;
+}
 
-    if (custom_music.buffer) {
-        free(custom_music.buffer);
-        custom_music.buffer = 0;
+static int ensure_scratch_size(int size)
+{
+    if (size <= custom_music.scratch_size) {
+        return 1;
+    }
+    Uint8 *scratch = (Uint8 *) realloc(custom_music.scratch, (size_t) size);
+    if (!scratch) {
+        return 0;
     }
+    custom_music.scratch = scratch;
+    custom_music.scratch_size = size;
+    return 1;
 }
 
 static int create_custom_audio_stream(SDL_AudioFormat src_format, Uint8 src_channels, int src_rate,
@@ -269,37 +374,64 @@ static int create_custom_audio_stream(SDL_AudioFormat src_format, Uint8 src_chan
             src_format, src_channels, src_rate,
             dst_format, dst_channels, dst_rate
         );
-        return custom_music.stream != 0;
+        if (!custom_music.stream) {
+            return 0;
+        }
+    } else {
+#endif
+        int result = SDL_BuildAudioCVT(
+            &custom_music.cvt, src_format, src_channels, src_rate,
+            dst_format, dst_channels, dst_rate
+        );
+        if (result < 0) {
+            return 0;
+        }
+#ifdef USE_SDL_AUDIOSTREAM
     }
 #endif
 
-    int result = SDL_BuildAudioCVT(
-        &custom_music.cvt, src_format, src_channels, src_rate,
-        dst_format, dst_channels, dst_rate
-    );
-    if (result < 0) {
-        return 0;
+    // Ring buffer for at least 2 seconds of 16-bit audio, a power of two so the positions can wrap around
+    int ring_size = 1;
+    while (ring_size < dst_rate * dst_channels * 2 * 2) {
+        ring_size *= 2;
     }
-
-    // Allocate buffer large enough for 2 seconds of 16-bit audio
-    custom_music.buffer_size = dst_rate * dst_channels * 2 * 2;
-    custom_music.buffer = malloc(custom_music.buffer_size);
-    if (!custom_music.buffer) {
+    custom_music.ring.data = (Uint8 *) malloc((size_t) ring_size);
+    // Conversion scratch for a quarter of a second, grown when a larger block arrives
+    if (!custom_music.ring.data || !ensure_scratch_size(ring_size / 8)) {
+        free_custom_audio_stream();
         return 0;
     }
-    custom_music.cur_read = 0;
-    custom_music.cur_write = 0;
+    custom_music.ring.size = ring_size;
+    SDL_AtomicSet(&custom_music.ring.read, 0);
+    SDL_AtomicSet(&custom_music.ring.write, 0);
+    SDL_AtomicSet(&custom_music.underruns, 0);
+    SDL_AtomicSet(&custom_music.overruns, 0);
     return 1;
 }
 
 static int custom_audio_stream_active(void)
 {
-#ifdef USE_SDL_AUDIOSTREAM
-    if (custom_music.use_audiostream) {
-        return custom_music.stream != 0;
+    return custom_music.ring.data != 0;
+}
+
+static void write_to_ring(const Uint8 *data, int len)
+{
+    unsigned int write = (unsigned int) SDL_AtomicGet(&custom_music.ring.write);
+    unsigned int read = (unsigned int) SDL_AtomicGet(&custom_music.ring.read);
+    int space = custom_music.ring.size - (int) (write - read);
+    if (len > space) {
+        SDL_AtomicAdd(&custom_music.overruns, 1);
+        len = space;
     }
-#endif
-    return custom_music.buffer != 0;
+    int start = (int) (write & (unsigned int) (custom_music.ring.size - 1));
+    int first_len = custom_music.ring.size - start;
+    if (first_len >= len) {
+        memcpy(&custom_music.ring.data[start], data, len);
+    } else {
+        memcpy(&custom_music.ring.data[start], data, first_len);
+        memcpy(custom_music.ring.data, &data[first_len], len - first_len);
+    }
+    SDL_AtomicSet(&custom_music.ring.write, (int) (write + (unsigned int) len));
 }
 
 static int put_custom_audio_stream(const Uint8 *audio_data, int len)
@@ -308,37 +440,33 @@ static int put_custom_audio_stream(const Uint8 *audio_data, int len)
         return 0;
     }
 
+    // Convert audio to the device format on this thread, the audio thread only reads the ring
 #ifdef USE_SDL_AUDIOSTREAM
     if (custom_music.use_audiostream) {
-        return SDL_AudioStreamPut(custom_music.stream, audio_data, len) == 0;
+        if (SDL_AudioStreamPut(custom_music.stream, audio_data, len) != 0) {
+            return 0;
+        }
+        int available = SDL_AudioStreamAvailable(custom_music.stream);
+        if (available > 0 && ensure_scratch_size(available)) {
+            int converted_len = SDL_AudioStreamGet(custom_music.stream, custom_music.scratch, available);
+            if (converted_len > 0) {
+                write_to_ring(custom_music.scratch, converted_len);
+            }
+        }
+        return 1;
     }
 #endif
 
-    // Convert audio to SDL format
-    custom_music.cvt.buf = (Uint8 *) malloc((size_t) (len * custom_music.cvt.len_mult));
-    if (!custom_music.cvt.buf) {
+    if (!ensure_scratch_size(len * custom_music.cvt.len_mult)) {
         return 0;
     }
-    memcpy(custom_music.cvt.buf, audio_data, len);
+    memcpy(custom_music.scratch, audio_data, len);
+    custom_music.cvt.buf = custom_music.scratch;
     custom_music.cvt.len = len;
     SDL_ConvertAudio(&custom_music.cvt);
-    int converted_len = custom_music.cvt.len_cvt;
-
-    // Copy data to circular buffer
-    if (converted_len + custom_music.cur_write <= custom_music.buffer_size) {
-        memcpy(&custom_music.buffer[custom_music.cur_write], custom_music.cvt.buf, converted_len);
-    } else {
-        int end_len = custom_music.buffer_size - custom_music.cur_write;
-        memcpy(&custom_music.buffer[custom_music.cur_write], custom_music.cvt.buf, end_len);
-        memcpy(custom_music.buffer, &custom_music.cvt.buf[end_len], converted_len - end_len);
-    }
-    custom_music.cur_write = (custom_music.cur_write + converted_len) % custom_music.buffer_size;
-
-    // Clean up
-    free(custom_music.cvt.buf);
+    write_to_ring(custom_music.scratch, custom_music.cvt.len_cvt);
     custom_music.cvt.buf = 0;
     custom_music.cvt.len = 0;
-
     return 1;
 }
 
@@ -350,51 +478,27 @@ static int get_custom_audio_stream(Uint8 *dst, int len)
     if (!dst || len <= 0 || !custom_audio_stream_active()) {
         return 0;
     }
-    int bytes_copied = 0;
-
-    // Mix audio to sound effect volume
-    Uint8 *mix_buffer = (Uint8 *) malloc(len);
-    if (!mix_buffer) {
-        return 0;
+    unsigned int read = (unsigned int) SDL_AtomicGet(&custom_music.ring.read);
+    unsigned int write = (unsigned int) SDL_AtomicGet(&custom_music.ring.write);
+    int available = (int) (write - read);
+    int bytes_copied = available < len ? available : len;
+    if (bytes_copied < len) {
+        SDL_AtomicAdd(&custom_music.underruns, 1);
     }
-    memset(mix_buffer, 0, len);
 
-#ifdef USE_SDL_AUDIOSTREAM
-    if (custom_music.use_audiostream) {
-        bytes_copied = SDL_AudioStreamGet(custom_music.stream, mix_buffer, len);
-        if (bytes_copied <= 0) {
-            return 0;
-        }
-    } else {
-#endif
-        if (custom_music.cur_read < custom_music.cur_write) {
-            int bytes_available = custom_music.cur_write - custom_music.cur_read;
-            int bytes_to_copy = bytes_available < len ? bytes_available : len;
-            memcpy(mix_buffer, &custom_music.buffer[custom_music.cur_read], bytes_to_copy);
-            bytes_copied = bytes_to_copy;
-        } else {
-            int bytes_available = custom_music.buffer_size - custom_music.cur_read;
-            int bytes_to_copy = bytes_available < len ? bytes_available : len;
-            memcpy(mix_buffer, &custom_music.buffer[custom_music.cur_read], bytes_to_copy);
-            bytes_copied = bytes_to_copy;
-            if (bytes_copied < len) {
-                int second_part_len = len - bytes_copied;
-                bytes_available = custom_music.cur_write;
-                bytes_to_copy = bytes_available < second_part_len ? bytes_available : second_part_len;
-                memcpy(&mix_buffer[bytes_copied], custom_music.buffer, bytes_to_copy);
-                bytes_copied += bytes_to_copy;
-            }
-        }
-        custom_music.cur_read = (custom_music.cur_read + bytes_copied) % custom_music.buffer_size;
-#ifdef USE_SDL_AUDIOSTREAM
+    // Mix audio to sound effect volume, straight from the ring
+    int volume = percentage_to_volume(setting_sound(SOUND_EFFECTS)->volume);
+    int start = (int) (read & (unsigned int) (custom_music.ring.size - 1));
+    int first_len = custom_music.ring.size - start;
+    if (first_len > bytes_copied) {
+        first_len = bytes_copied;
     }
-#endif
-
-    SDL_MixAudioFormat(dst, mix_buffer,
-        custom_music.dst_format, bytes_copied,
-        percentage_to_volume(setting_sound(SOUND_EFFECTS)->volume));
-    free(mix_buffer);
-
+    SDL_MixAudioFormat(dst, &custom_music.ring.data[start], custom_music.dst_format, first_len, volume);
+    if (first_len < bytes_copied) {
+        SDL_MixAudioFormat(&dst[first_len], custom_music.ring.data, custom_music.dst_format,
+            bytes_copied - first_len, volume);
+    }
+    SDL_AtomicSet(&custom_music.ring.read, (int) (read + (unsigned int) bytes_copied));
     return bytes_copied;
 }
 
@@ -421,6 +525,9 @@ void sound_device_use_custom_music_player(int bitdepth, int num_channels, int ra
     Mix_QuerySpec(&device_rate, &device_format, &device_channels);
     custom_music.format = format;
 
+    // The audio thread must stop reading the ring before it is replaced
+    Mix_HookMusic(0, 0);
+
     int result = create_custom_audio_stream(
         format, num_channels, rate,
         device_format, device_channels, device_rate
@@ -445,5 +552,9 @@ void sound_device_write_custom_music_data(const unsigned char *audio_data, int l
 void sound_device_use_default_music_player(void)
 {
     Mix_HookMusic(0, 0);
+    if (custom_audio_stream_active()) {
+        log_info("Custom music underruns:", 0, SDL_AtomicGet(&custom_music.underruns));
+        log_info("Custom music overruns:", 0, SDL_AtomicGet(&custom_music.overruns));
+    }
     free_custom_audio_stream();
 }
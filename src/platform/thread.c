@@ -0,0 +1,223 @@
+#include "platform/thread.h"
+
+#include "SDL.h"
+
+#define MAX_WORKER_THREADS 7
+
+static struct {
+    int initialized;
+    int num_workers;
+    int quit;
+    SDL_Thread *workers[MAX_WORKER_THREADS];
+    SDL_mutex *mutex;
+    SDL_cond *work_available;
+    SDL_cond *work_done;
+    int busy;
+    platform_thread_task *task;
+    void *userdata;
+    int num_tasks;
+    int next_task;
+    int tasks_done;
+} pool;
+
+// Must be called with the pool mutex locked
+static int run_next_task(void)
+{
+    if (pool.next_task >= pool.num_tasks) {
+        return 0;
+    }
+    int index = pool.next_task++;
+    platform_thread_task *task = pool.task;
+    void *userdata = pool.userdata;
+    SDL_UnlockMutex(pool.mutex);
+    task(index, userdata);
+    SDL_LockMutex(pool.mutex);
+    pool.tasks_done++;
+    if (pool.tasks_done == pool.num_tasks) {
+        SDL_CondBroadcast(pool.work_done);
+    }
+    return 1;
+}
+
+static int worker_loop(__attribute__((unused)) void *data)
+{
+    SDL_LockMutex(pool.mutex);
+    while (!pool.quit) {
+        if (!run_next_task()) {
+            SDL_CondWait(pool.work_available, pool.mutex);
+        }
+    }
+    SDL_UnlockMutex(pool.mutex);
+    return 0;
+}
+
+static int init_pool(void)
+{
+    if (pool.initialized) {
+        return pool.num_workers > 0;
+    }
+    pool.initialized = 1;
+    int num_workers = SDL_GetCPUCount() - 1;
+    if (num_workers > MAX_WORKER_THREADS) {
+        num_workers = MAX_WORKER_THREADS;
+    }
+    if (num_workers <= 0) {
+        return 0;
+    }
+    pool.mutex = SDL_CreateMutex();
+    pool.work_available = SDL_CreateCond();
+    pool.work_done = SDL_CreateCond();
+    if (!pool.mutex || !pool.work_available || !pool.work_done) {
+        SDL_Log("Unable to create worker pool: %s", SDL_GetError());
+        return 0;
+    }
+    for (int i = 0; i < num_workers; i++) {
+        pool.workers[i] = SDL_CreateThread(worker_loop, "worker", 0);
+        if (!pool.workers[i]) {
+            SDL_Log("Unable to create worker thread: %s", SDL_GetError());
+            break;
+        }
+        pool.num_workers++;
+    }
+    SDL_Log("Worker pool started with %d threads", pool.num_workers);
+    return pool.num_workers > 0;
+}
+
+int platform_thread_max_parallel_tasks(void)
+{
+    init_pool();
+    return pool.num_workers + 1;
+}
+
+static void run_serial(platform_thread_task *task, int num_tasks, void *userdata)
+{
+    for (int i = 0; i < num_tasks; i++) {
+        task(i, userdata);
+    }
+}
+
+void platform_thread_run_tasks(platform_thread_task *task, int num_tasks, void *userdata)
+{
+    if (num_tasks <= 1 || !init_pool()) {
+        run_serial(task, num_tasks, userdata);
+        return;
+    }
+    SDL_LockMutex(pool.mutex);
+    if (pool.busy) {
+        // Nested call or another thread is using the pool
+        SDL_UnlockMutex(pool.mutex);
+        run_serial(task, num_tasks, userdata);
+        return;
+    }
+    pool.busy = 1;
+    pool.task = task;
+    pool.userdata = userdata;
+    pool.num_tasks = num_tasks;
+    pool.next_task = 0;
+    pool.tasks_done = 0;
+    SDL_CondBroadcast(pool.work_available);
+
+    while (run_next_task()) {
+        // keep helping until all tasks are taken
+    }
+    while (pool.tasks_done < pool.num_tasks) {
+        SDL_CondWait(pool.work_done, pool.mutex);
+    }
+    pool.num_tasks = 0;
+    pool.next_task = 0;
+    pool.busy = 0;
+    SDL_UnlockMutex(pool.mutex);
+}
+
+platform_thread *platform_thread_create(platform_thread_function *function, const char *name, void *userdata)
+{
+    SDL_Thread *thread = SDL_CreateThread(function, name, userdata);
+    if (!thread) {
+        SDL_Log("Unable to create thread %s: %s", name, SDL_GetError());
+    }
+    return (platform_thread *) thread;
+}
+
+int platform_thread_wait(platform_thread *thread)
+{
+    int result = 0;
+    SDL_WaitThread((SDL_Thread *) thread, &result);
+    return result;
+}
+
+platform_mutex *platform_mutex_create(void)
+{
+    SDL_mutex *mutex = SDL_CreateMutex();
+    if (!mutex) {
+        SDL_Log("Unable to create mutex: %s", SDL_GetError());
+    }
+    return (platform_mutex *) mutex;
+}
+
+void platform_mutex_lock(platform_mutex *mutex)
+{
+    SDL_LockMutex((SDL_mutex *) mutex);
+}
+
+void platform_mutex_unlock(platform_mutex *mutex)
+{
+    SDL_UnlockMutex((SDL_mutex *) mutex);
+}
+
+void platform_mutex_destroy(platform_mutex *mutex)
+{
+    if (mutex) {
+        SDL_DestroyMutex((SDL_mutex *) mutex);
+    }
+}
+
+platform_condition *platform_condition_create(void)
+{
+    SDL_cond *condition = SDL_CreateCond();
+    if (!condition) {
+        SDL_Log("Unable to create condition: %s", SDL_GetError());
+    }
+    return (platform_condition *) condition;
+}
+
+void platform_condition_wait(platform_condition *condition, platform_mutex *mutex)
+{
+    SDL_CondWait((SDL_cond *) condition, (SDL_mutex *) mutex);
+}
+
+void platform_condition_signal(platform_condition *condition)
+{
+    SDL_CondBroadcast((SDL_cond *) condition);
+}
+
+void platform_condition_destroy(platform_condition *condition)
+{
+    if (condition) {
+        SDL_DestroyCond((SDL_cond *) condition);
+    }
+}
+
+void *platform_atomic_get_ptr(void **ptr)
+{
+    return SDL_AtomicGetPtr(ptr);
+}
+
+int platform_atomic_cas_ptr(void **ptr, void *old_value, void *new_value)
+{
+    return SDL_AtomicCASPtr(ptr, old_value, new_value) == SDL_TRUE;
+}
+
+void platform_thread_shutdown(void)
+{
+    if (!pool.num_workers) {
+        return;
+    }
+    SDL_LockMutex(pool.mutex);
+    pool.quit = 1;
+    SDL_CondBroadcast(pool.work_available);
+    SDL_UnlockMutex(pool.mutex);
+    for (int i = 0; i < pool.num_workers; i++) {
+        SDL_WaitThread(pool.workers[i], 0);
+    }
+    pool.num_workers = 0;
+}
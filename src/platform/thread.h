@@ -0,0 +1,137 @@
+#ifndef PLATFORM_THREAD_H
+#define PLATFORM_THREAD_H
+
+/**
+ * @file
+ * Threading support.
+ */
+
+#if defined(_MSC_VER)
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL __thread
+#endif
+
+/**
+ * Task function to run on the worker pool
+ * @param task_index Index of the task, from 0 to num_tasks - 1
+ * @param userdata User data passed to platform_thread_run_tasks
+ */
+typedef void (platform_thread_task)(int task_index, void *userdata);
+
+/**
+ * Gets the number of tasks that can run at the same time, including the calling thread
+ * @return Number of parallel tasks, at least 1
+ */
+int platform_thread_max_parallel_tasks(void);
+
+/**
+ * Runs the tasks on the worker pool and waits for all of them to finish.
+ * The calling thread also runs tasks. When the pool is busy or unavailable,
+ * the tasks are run on the calling thread in order.
+ * @param task Task function
+ * @param num_tasks Number of tasks to run
+ * @param userdata User data to pass to each task
+ */
+void platform_thread_run_tasks(platform_thread_task *task, int num_tasks, void *userdata);
+
+typedef struct platform_thread platform_thread;
+
+/**
+ * Function to run on a separate thread
+ * @param userdata User data passed to platform_thread_create
+ * @return Result code, returned by platform_thread_wait
+ */
+typedef int (platform_thread_function)(void *userdata);
+
+/**
+ * Starts a new thread
+ * @param function Function to run on the thread
+ * @param name Name of the thread
+ * @param userdata User data to pass to the function
+ * @return Thread, or null if the thread could not be created
+ */
+platform_thread *platform_thread_create(platform_thread_function *function, const char *name, void *userdata);
+
+/**
+ * Waits for a thread to finish and releases it
+ * @param thread Thread to wait for
+ * @return Result of the thread function
+ */
+int platform_thread_wait(platform_thread *thread);
+
+typedef struct platform_mutex platform_mutex;
+
+/**
+ * Creates a mutex
+ * @return Mutex, or null on failure
+ */
+platform_mutex *platform_mutex_create(void);
+
+/**
+ * Locks a mutex, waiting until it is available
+ * @param mutex Mutex to lock
+ */
+void platform_mutex_lock(platform_mutex *mutex);
+
+/**
+ * Unlocks a mutex
+ * @param mutex Mutex to unlock
+ */
+void platform_mutex_unlock(platform_mutex *mutex);
+
+/**
+ * Destroys a mutex
+ * @param mutex Mutex to destroy, may be null
+ */
+void platform_mutex_destroy(platform_mutex *mutex);
+
+typedef struct platform_condition platform_condition;
+
+/**
+ * Creates a condition variable
+ * @return Condition variable, or null on failure
+ */
+platform_condition *platform_condition_create(void);
+
+/**
+ * Unlocks the mutex and waits until the condition is signalled, then locks the mutex again
+ * @param condition Condition to wait for
+ * @param mutex Locked mutex protecting the condition
+ */
+void platform_condition_wait(platform_condition *condition, platform_mutex *mutex);
+
+/**
+ * Wakes up all threads waiting for the condition
+ * @param condition Condition to signal
+ */
+void platform_condition_signal(platform_condition *condition);
+
+/**
+ * Destroys a condition variable
+ * @param condition Condition to destroy, may be null
+ */
+void platform_condition_destroy(platform_condition *condition);
+
+/**
+ * Atomically reads a pointer
+ * @param ptr Location of the pointer
+ * @return The pointer value
+ */
+void *platform_atomic_get_ptr(void **ptr);
+
+/**
+ * Atomically sets a pointer if it still has the expected value
+ * @param ptr Location of the pointer
+ * @param old_value Expected current value
+ * @param new_value Value to set
+ * @return boolean true if the pointer was set, false if it had changed
+ */
+int platform_atomic_cas_ptr(void **ptr, void *old_value, void *new_value);
+
+/**
+ * Stops the worker pool threads
+ */
+void platform_thread_shutdown(void);
+
+#endif // PLATFORM_THREAD_H
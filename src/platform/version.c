@@ -0,0 +1,11 @@
+// DO NOT EDIT. This file is generated by CMake.
+// Run CMake configure step to update it.
+#include "game/system.h"
+
+#define BRUTUS_VERSION "1.7.0"
+#define BRUTUS_VERSION_SUFFIX "-20261019-7e66930"
+
+const char *system_version(void)
+{
+    return BRUTUS_VERSION BRUTUS_VERSION_SUFFIX;
+}
@@ -13,6 +13,7 @@
 #include "core/time.h"
 #include "figure/formation_legion.h"
 #include "game/resource.h"
+#include "graphics/graphics.h"
 #include "graphics/image.h"
 #include "graphics/window.h"
 #include "map/building.h"
@@ -22,6 +23,7 @@
 #include "map/property.h"
 #include "map/sprite.h"
 #include "map/terrain.h"
+#include "platform/thread.h"
 #include "sound/city.h"
 #include "widget/city_bridge.h"
 #include "widget/city_building_ghost.h"
@@ -29,6 +31,11 @@
 
 #define OFFSET(x,y) (x + GRID_SIZE * y)
 
+#define MIN_BAND_HEIGHT 60
+#define MAX_BANDS 8
+
+#define ANIMATION_REMOVED_BRIDGE -1
+
 static const int ADJACENT_OFFSETS[2][4][7] = {
     {
         {OFFSET(-1, 0), OFFSET(-1, -1),  OFFSET(-1, -2), OFFSET(0, -2), OFFSET(1, -2)},
@@ -53,8 +60,20 @@ static struct {
     int selected_figure_id;
     int highlighted_formation;
     pixel_coordinate *selected_figure_coord;
+
+    int use_cached_animations;
+    int animation_offsets[GRID_SIZE * GRID_SIZE];
 } draw_context;
 
+typedef struct {
+    int x;
+    int y;
+    int width;
+    int height;
+    int band_height;
+    void (*draw)(void);
+} band_info;
+
 static void init_draw_context(int selected_figure_id, pixel_coordinate *figure_coord, int highlighted_formation)
 {
     draw_context.advance_water_animation = 0;
@@ -97,9 +116,45 @@ static int has_adjacent_deletion(int grid_offset)
     return 0;
 }
 
-static void draw_footprint(int x, int y, int grid_offset)
+static void update_footprint(int x, int y, int grid_offset)
 {
     building_construction_record_view_position(x, y, grid_offset);
+    if (grid_offset < 0 || !map_property_is_draw_tile(grid_offset)) {
+        return;
+    }
+    int building_id = map_building_at(grid_offset);
+    if (building_id) {
+        building *b = building_get(building_id);
+        int view_x, view_y, view_width, view_height;
+        city_view_get_viewport(&view_x, &view_y, &view_width, &view_height);
+        if (x < view_x + 100) {
+            sound_city_mark_building_view(b, SOUND_DIRECTION_LEFT);
+        } else if (x > view_x + view_width - 100) {
+            sound_city_mark_building_view(b, SOUND_DIRECTION_RIGHT);
+        } else {
+            sound_city_mark_building_view(b, SOUND_DIRECTION_CENTER);
+        }
+    }
+    if (map_terrain_is(grid_offset, TERRAIN_GARDEN)) {
+        building *b = building_get(0); // abuse empty building
+        b->type = BUILDING_GARDENS;
+        sound_city_mark_building_view(b, SOUND_DIRECTION_CENTER);
+    }
+    int image_id = map_image_at(grid_offset);
+    if (!map_property_is_constructing(grid_offset) &&
+        draw_context.advance_water_animation &&
+        image_id >= draw_context.image_id_water_first &&
+        image_id <= draw_context.image_id_water_last) {
+        image_id++;
+        if (image_id > draw_context.image_id_water_last) {
+            image_id = draw_context.image_id_water_first;
+        }
+        map_image_set(grid_offset, image_id);
+    }
+}
+
+static void draw_footprint_tile(int x, int y, int grid_offset)
+{
     if (grid_offset < 0) {
         // Outside map: draw black tile
         image_draw_isometric_footprint_from_draw_tile(image_group(GROUP_TERRAIN_BLACK), x, y, 0);
@@ -107,43 +162,23 @@ static void draw_footprint(int x, int y, int grid_offset)
         // Valid grid_offset and leftmost tile -> draw
         int building_id = map_building_at(grid_offset);
         color_t color_mask = 0;
-        if (building_id) {
-            building *b = building_get(building_id);
-            if (draw_building_as_deleted(b)) {
-                color_mask = COLOR_MASK_RED;
-            }
-            int view_x, view_y, view_width, view_height;
-            city_view_get_viewport(&view_x, &view_y, &view_width, &view_height);
-            if (x < view_x + 100) {
-                sound_city_mark_building_view(b, SOUND_DIRECTION_LEFT);
-            } else if (x > view_x + view_width - 100) {
-                sound_city_mark_building_view(b, SOUND_DIRECTION_RIGHT);
-            } else {
-                sound_city_mark_building_view(b, SOUND_DIRECTION_CENTER);
-            }
-        }
-        if (map_terrain_is(grid_offset, TERRAIN_GARDEN)) {
-            building *b = building_get(0); // abuse empty building
-            b->type = BUILDING_GARDENS;
-            sound_city_mark_building_view(b, SOUND_DIRECTION_CENTER);
+        if (building_id && draw_building_as_deleted(building_get(building_id))) {
+            color_mask = COLOR_MASK_RED;
         }
         int image_id = map_image_at(grid_offset);
         if (map_property_is_constructing(grid_offset)) {
             image_id = image_group(GROUP_TERRAIN_OVERLAY);
         }
-        if (draw_context.advance_water_animation &&
-            image_id >= draw_context.image_id_water_first &&
-            image_id <= draw_context.image_id_water_last) {
-            image_id++;
-            if (image_id > draw_context.image_id_water_last) {
-                image_id = draw_context.image_id_water_first;
-            }
-            map_image_set(grid_offset, image_id);
-        }
         image_draw_isometric_footprint_from_draw_tile(image_id, x, y, color_mask);
     }
 }
 
+static void draw_footprint(int x, int y, int grid_offset)
+{
+    update_footprint(x, y, grid_offset);
+    draw_footprint_tile(x, y, grid_offset);
+}
+
 static void draw_hippodrome_spectators(const building *b, int x, int y, color_t color_mask)
 {
     int subtype = b->subtype.orientation;
@@ -358,10 +393,38 @@ static void draw_granary_stores(const image *img, const building *b, int x, int
     }
 }
 
+static void update_animation(__attribute__((unused)) int x, __attribute__((unused)) int y, int grid_offset)
+{
+    int image_id = map_image_at(grid_offset);
+    const image *img = image_get(image_id);
+    int offset = 0;
+    if (img->num_animation_sprites) {
+        if (map_property_is_draw_tile(grid_offset)) {
+            offset = building_animation_offset(building_get(map_building_at(grid_offset)), image_id, grid_offset);
+        }
+    } else if (map_sprite_bridge_at(grid_offset) && !map_terrain_is(grid_offset, TERRAIN_WATER)) {
+        map_sprite_clear_tile(grid_offset);
+        offset = ANIMATION_REMOVED_BRIDGE;
+    }
+    draw_context.animation_offsets[grid_offset] = offset;
+}
+
+static int animation_offset(building *b, int image_id, int grid_offset)
+{
+    if (!draw_context.use_cached_animations) {
+        return building_animation_offset(b, image_id, grid_offset);
+    }
+    return grid_offset >= 0 ? draw_context.animation_offsets[grid_offset] : 0;
+}
+
 static void draw_animation(int x, int y, int grid_offset)
 {
     int image_id = map_image_at(grid_offset);
     const image *img = image_get(image_id);
+    if (draw_context.use_cached_animations && grid_offset >= 0 &&
+        draw_context.animation_offsets[grid_offset] == ANIMATION_REMOVED_BRIDGE) {
+        return;
+    }
     if (img->num_animation_sprites) {
         if (map_property_is_draw_tile(grid_offset)) {
             int building_id = map_building_at(grid_offset);
@@ -379,13 +442,13 @@ static void draw_animation(int x, int y, int grid_offset)
             } else if (b->type == BUILDING_BURNING_RUIN && b->ruin_has_plague) {
                 image_draw_masked(image_group(GROUP_PLAGUE_SKULL), x + 18, y - 32, color_mask);
             }
-            int animation_offset = building_animation_offset(b, image_id, grid_offset);
-            if (b->type != BUILDING_HIPPODROME && animation_offset > 0) {
-                if (animation_offset > img->num_animation_sprites) {
-                    animation_offset = img->num_animation_sprites;
+            int sprite_offset = animation_offset(b, image_id, grid_offset);
+            if (b->type != BUILDING_HIPPODROME && sprite_offset > 0) {
+                if (sprite_offset > img->num_animation_sprites) {
+                    sprite_offset = img->num_animation_sprites;
                 }
                 if (b->type == BUILDING_GRANARY) {
-                    image_draw_masked(image_id + animation_offset + 5, x + 77, y - 49, color_mask);
+                    image_draw_masked(image_id + sprite_offset + 5, x + 77, y - 49, color_mask);
                 } else {
                     int ydiff = 0;
                     switch (map_property_multi_tile_size(grid_offset)) {
@@ -395,7 +458,7 @@ static void draw_animation(int x, int y, int grid_offset)
                         case 4: ydiff = 75; break;
                         case 5: ydiff = 90; break;
                     }
-                    image_draw_masked(image_id + animation_offset,
+                    image_draw_masked(image_id + sprite_offset,
                                       x + img->sprite_offset_x,
                                       y + ydiff + img->sprite_offset_y - img->height,
                                       color_mask);
@@ -502,6 +565,92 @@ static void deletion_draw_remaining(int x, int y, int grid_offset)
     draw_hippodrome_ornaments(x, y, grid_offset);
 }
 
+static void draw_terrain_and_buildings(void)
+{
+    city_view_foreach_map_tile(draw_footprint_tile);
+    city_view_foreach_valid_map_tile(
+        draw_top,
+        draw_figures,
+        draw_animation
+    );
+}
+
+static void draw_elevated(void)
+{
+    city_view_foreach_valid_map_tile(
+        draw_elevated_figures,
+        draw_hippodrome_ornaments,
+        0
+    );
+}
+
+static void draw_deletion(void)
+{
+    city_view_foreach_map_tile(deletion_draw_terrain_top);
+    city_view_foreach_map_tile(deletion_draw_figures_animations);
+    city_view_foreach_map_tile(deletion_draw_remaining);
+}
+
+static void draw_footprints_and_deletion(void)
+{
+    city_view_foreach_map_tile(draw_footprint_tile);
+    draw_deletion();
+}
+
+static void draw_band(int band, void *userdata)
+{
+    const band_info *info = (const band_info *) userdata;
+    int y_offset = band * info->band_height;
+    int height = info->band_height;
+    if (y_offset + height > info->height) {
+        height = info->height - y_offset;
+    }
+    graphics_set_clip_rectangle(info->x, info->y + y_offset, info->width, height);
+    info->draw();
+}
+
+static void draw_in_bands(int num_bands, void (*draw)(void))
+{
+    int x, y, width, height;
+    city_view_get_viewport(&x, &y, &width, &height);
+    band_info info = { x, y, width, height, (height + num_bands - 1) / num_bands, draw };
+    platform_thread_run_tasks(draw_band, num_bands, &info);
+    graphics_set_clip_rectangle(x, y, width, height);
+}
+
+static int get_num_bands(int selected_figure_id)
+{
+    if (selected_figure_id || !config_get(CONFIG_SCREEN_THREADED_CITY_DRAWING)) {
+        return 1;
+    }
+    int x, y, width, height;
+    city_view_get_viewport(&x, &y, &width, &height);
+    int num_bands = platform_thread_max_parallel_tasks();
+    if (num_bands > MAX_BANDS) {
+        num_bands = MAX_BANDS;
+    }
+    if (num_bands > height / MIN_BAND_HEIGHT) {
+        num_bands = height / MIN_BAND_HEIGHT;
+    }
+    return num_bands;
+}
+
+static void draw_banded(int num_bands, int should_mark_deleting, const map_tile *tile)
+{
+    // Everything that changes game state is done up front, so the bands only draw
+    city_view_foreach_map_tile(update_footprint);
+    city_view_foreach_valid_map_tile(update_animation, 0, 0);
+    draw_context.use_cached_animations = 1;
+    if (!should_mark_deleting) {
+        draw_in_bands(num_bands, draw_terrain_and_buildings);
+        city_building_ghost_draw(tile);
+        draw_in_bands(num_bands, draw_elevated);
+    } else {
+        draw_in_bands(num_bands, draw_footprints_and_deletion);
+    }
+    draw_context.use_cached_animations = 0;
+}
+
 void city_without_overlay_draw(int selected_figure_id, pixel_coordinate *figure_coord, const map_tile *tile)
 {
     int highlighted_formation = 0;
@@ -519,6 +668,11 @@ void city_without_overlay_draw(int selected_figure_id, pixel_coordinate *figure_
     }
     init_draw_context(selected_figure_id, figure_coord, highlighted_formation);
     int should_mark_deleting = city_building_ghost_mark_deleting(tile);
+    int num_bands = get_num_bands(selected_figure_id);
+    if (num_bands > 1) {
+        draw_banded(num_bands, should_mark_deleting, tile);
+        return;
+    }
     city_view_foreach_map_tile(draw_footprint);
     if (!should_mark_deleting) {
         city_view_foreach_valid_map_tile(
@@ -529,14 +683,8 @@ void city_without_overlay_draw(int selected_figure_id, pixel_coordinate *figure_
         if (!selected_figure_id) {
             city_building_ghost_draw(tile);
         }
-        city_view_foreach_valid_map_tile(
-            draw_elevated_figures,
-            draw_hippodrome_ornaments,
-            0
-        );
+        draw_elevated();
     } else {
-        city_view_foreach_map_tile(deletion_draw_terrain_top);
-        city_view_foreach_map_tile(deletion_draw_figures_animations);
-        city_view_foreach_map_tile(deletion_draw_remaining);
+        draw_deletion();
     }
 }
@@ -12,6 +12,7 @@
 #include "figure/formation_legion.h"
 #include "game/cheats.h"
 #include "game/file.h"
+#include "game/file_io.h"
 #include "game/orientation.h"
 #include "game/settings.h"
 #include "game/state.h"
@@ -40,6 +41,11 @@
 static int any_selected_legion_index = 0;
 static int current_selected_legion_index = 0;
 
+static struct {
+    int restored;
+    int time_stamp;
+} snapshot_restore;
+
 void window_city_draw_background(void)
 {
     widget_sidebar_city_draw_background();
@@ -194,6 +200,23 @@ void replay_map(void)
     window_popup_dialog_show_confirmation(1, 2, replay_map_confirmed);
 }
 
+static int get_game_time_stamp(void)
+{
+    return ((game_time_year() * 16 + game_time_month()) * 16 + game_time_day()) * 64 + game_time_tick();
+}
+
+static void restore_snapshot(void)
+{
+    building_construction_clear_type();
+    // Restoring again before the game moves on steps further back in time
+    int age = snapshot_restore.restored && snapshot_restore.time_stamp == get_game_time_stamp() ? 1 : 0;
+    if (game_file_restore_snapshot(age)) {
+        snapshot_restore.restored = 1;
+        snapshot_restore.time_stamp = get_game_time_stamp();
+        window_city_show();
+    }
+}
+
 static void handle_hotkeys(const hotkeys *h)
 {
     if (h->load_file) {
@@ -202,6 +225,13 @@ static void handle_hotkeys(const hotkeys *h)
     if (h->save_file) {
         window_file_dialog_show(FILE_TYPE_SAVED_GAME, FILE_DIALOG_SAVE);
     }
+    if (h->take_snapshot) {
+        game_file_io_take_snapshot();
+        snapshot_restore.restored = 0;
+    }
+    if (h->restore_snapshot) {
+        restore_snapshot();
+    }
     if (h->decrease_game_speed) {
         setting_decrease_game_speed();
     }
@@ -353,3 +383,9 @@ void window_city_return(void)
         window_city_show();
     }
 }
+
+void window_city_reset_snapshot_restore(void)
+{
+    snapshot_restore.restored = 0;
+    snapshot_restore.time_stamp = 0;
+}
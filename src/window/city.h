@@ -13,4 +13,6 @@ void window_city_military_show(int legion_formation_id);
 
 void window_city_return(void);
 
+void window_city_reset_snapshot_restore(void);
+
 #endif // WINDOW_CITY_H
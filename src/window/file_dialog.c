@@ -10,6 +10,7 @@
 #include "game/file.h"
 #include "game/file_io.h"
 #include "game/file_editor.h"
+#include "game/save_index.h"
 #include "graphics/generic_button.h"
 #include "graphics/graphics.h"
 #include "graphics/image.h"
@@ -29,6 +30,7 @@
 
 #define NUM_FILES_IN_VIEW 12
 #define MAX_FILE_WINDOW_TEXT_WIDTH (18 * BLOCK_SIZE)
+#define INFO_Y_OFFSET 378
 
 static const time_millis NOT_EXIST_MESSAGE_TIMEOUT = 500;
 
@@ -141,6 +143,9 @@ static void init(file_type type, file_dialog_type dialog_type)
     string_copy(data.typed_name, data.previously_seen_typed_name, FILE_NAME_MAX);
 
     data.file_list = dir_find_files_with_extension(data.file_data->extension);
+    if (type == FILE_TYPE_SAVED_GAME) {
+        game_save_index_refresh();
+    }
     scrollbar_init(&scrollbar, 0, data.file_list->num_files - NUM_FILES_IN_VIEW);
     scroll_to_typed_text();
 
@@ -148,12 +153,33 @@ static void init(file_type type, file_dialog_type dialog_type)
     input_box_start(&file_name_input);
 }
 
+static void draw_saved_game_info(void)
+{
+    const char *filename = 0;
+    int focus_index = scrollbar.scroll_position + data.focus_button_id - 1;
+    if (data.focus_button_id && focus_index < data.file_list->num_files) {
+        filename = data.file_list->files[focus_index];
+    } else if (data.selected_file[0]) {
+        filename = data.selected_file;
+    }
+    const saved_game_info *info = filename ? game_save_index_get(SAVES_DIR_PATH, filename) : 0;
+    if (!info) {
+        return;
+    }
+    int width = lang_text_draw(6, 0, 160, INFO_Y_OFFSET, FONT_NORMAL_BLACK);
+    text_draw_number(info->treasury, '@', " ", 160 + width, INFO_Y_OFFSET, FONT_NORMAL_BLACK);
+    width = lang_text_draw(6, 1, 270, INFO_Y_OFFSET, FONT_NORMAL_BLACK);
+    text_draw_number(info->population, '@', " ", 270 + width, INFO_Y_OFFSET, FONT_NORMAL_BLACK);
+    lang_text_draw_month_year_max_width(info->month, info->year, 370, INFO_Y_OFFSET, 90, FONT_NORMAL_BLACK, 0);
+}
+
 static void draw_foreground(void)
 {
     graphics_in_dialog();
     uint8_t file[FILE_NAME_MAX];
 
-    outer_panel_draw(128, 40, 24, 21);
+    // Saved games get an extra line with the summary of the focused file
+    outer_panel_draw(128, 40, 24, data.type == FILE_TYPE_SAVED_GAME ? 23 : 21);
     input_box_draw(&file_name_input);
     inner_panel_draw(144, 120, 20, 13);
 
@@ -180,6 +206,10 @@ static void draw_foreground(void)
         text_draw(file, 160, 130 + 16 * i, font, 0);
     }
 
+    if (data.type == FILE_TYPE_SAVED_GAME) {
+        draw_saved_game_info();
+    }
+
     image_buttons_draw(0, 0, image_buttons, 2);
     scrollbar_draw(&scrollbar);
 
@@ -217,6 +247,7 @@ static void handle_input(const mouse *m, const hotkeys *h)
         return;
     }
     if (input_go_back_requested(m, h)) {
+        game_save_index_save();
         input_box_stop(&file_name_input);
         window_go_back();
     }
@@ -247,6 +278,7 @@ static const char *get_chosen_filename(void)
 
 static void button_ok_cancel(int is_ok, __attribute__((unused)) int param2)
 {
+    game_save_index_save();
     if (!is_ok) {
         input_box_stop(&file_name_input);
         window_go_back();
@@ -52,6 +52,8 @@ static hotkey_widget hotkey_widgets[] = {
     {HOTKEY_SAVE_CITY_SCREENSHOT, TR_HOTKEY_SAVE_CITY_SCREENSHOT, 0, 0},
     {HOTKEY_LOAD_FILE, TR_HOTKEY_LOAD_FILE, 0, 0},
     {HOTKEY_SAVE_FILE, TR_HOTKEY_SAVE_FILE, 0, 0},
+    {HOTKEY_TAKE_SNAPSHOT, TR_HOTKEY_TAKE_SNAPSHOT, 0, 0},
+    {HOTKEY_RESTORE_SNAPSHOT, TR_HOTKEY_RESTORE_SNAPSHOT, 0, 0},
     {HOTKEY_HEADER, TR_HOTKEY_HEADER_CITY, 0, 0},
     {HOTKEY_DECREASE_GAME_SPEED, TR_HOTKEY_DECREASE_GAME_SPEED, 0, 0},
     {HOTKEY_INCREASE_GAME_SPEED, TR_HOTKEY_INCREASE_GAME_SPEED, 0, 0},
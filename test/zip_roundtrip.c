@@ -0,0 +1,172 @@
+/**
+ * Round-trip check for zip_compress: every compression level must produce data
+ * that zip_decompress turns back into the original input.
+ *
+ * Usage: zip_roundtrip [file...]
+ * Without arguments, generated payloads are checked. Any files given, for example
+ * saved game pieces, are checked as well and their timings are printed.
+ */
+#include "core/log.h"
+#include "core/zip.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define NUM_LEVELS 3
+
+static const char *LEVEL_NAMES[NUM_LEVELS] = { "fastest", "fast", "best" };
+static const zip_compression_level LEVELS[NUM_LEVELS] = {
+    ZIP_COMPRESSION_FASTEST, ZIP_COMPRESSION_FAST, ZIP_COMPRESSION_BEST
+};
+
+static uint32_t random_state = 0x12345678;
+
+void log_info(const char *msg, const char *param_str, int param_int)
+{
+    printf("%s %s %d\n", msg, param_str ? param_str : "", param_int);
+}
+
+void log_error(const char *msg, const char *param_str, int param_int)
+{
+    fprintf(stderr, "%s %s %d\n", msg, param_str ? param_str : "", param_int);
+}
+
+static uint32_t next_random(void)
+{
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    return random_state;
+}
+
+static double seconds_since(clock_t start)
+{
+    return (double) (clock() - start) / CLOCKS_PER_SEC;
+}
+
+static int check_payload(const char *name, const uint8_t *data, int length, int verbose)
+{
+    int max_compressed = 2 * length + 4096;
+    uint8_t *compressed = (uint8_t *) malloc(max_compressed);
+    uint8_t *decompressed = (uint8_t *) malloc(length + 1);
+    if (!compressed || !decompressed) {
+        free(compressed);
+        free(decompressed);
+        fprintf(stderr, "%s: out of memory\n", name);
+        return 0;
+    }
+    int ok = 1;
+    for (int i = 0; i < NUM_LEVELS && ok; i++) {
+        int compressed_length = max_compressed;
+        clock_t start = clock();
+        if (!zip_compress(data, length, compressed, &compressed_length, LEVELS[i])) {
+            fprintf(stderr, "%s: compression failed at level %s\n", name, LEVEL_NAMES[i]);
+            ok = 0;
+            break;
+        }
+        double compress_time = seconds_since(start);
+        int decompressed_length = length;
+        start = clock();
+        if (!zip_decompress(compressed, compressed_length, decompressed, &decompressed_length) ||
+            decompressed_length != length || memcmp(data, decompressed, length) != 0) {
+            fprintf(stderr, "%s: round trip failed at level %s\n", name, LEVEL_NAMES[i]);
+            ok = 0;
+            break;
+        }
+        if (verbose) {
+            printf("%s: %-7s %d -> %d bytes, compress %.3f s, decompress %.3f s\n", name, LEVEL_NAMES[i],
+                length, compressed_length, compress_time, seconds_since(start));
+        }
+    }
+    free(compressed);
+    free(decompressed);
+    return ok;
+}
+
+static void fill_random(uint8_t *data, int length)
+{
+    for (int i = 0; i < length; i++) {
+        data[i] = (uint8_t) next_random();
+    }
+}
+
+static void fill_sparse(uint8_t *data, int length)
+{
+    memset(data, 0, length);
+    for (int i = 0; i < length / 16; i++) {
+        data[next_random() % length] = (uint8_t) next_random();
+    }
+}
+
+static void fill_repetitive(uint8_t *data, int length)
+{
+    // Short words drawn from a small vocabulary, like the grids in a saved game
+    static const uint8_t WORDS[8][4] = {
+        { 1, 0, 0, 0 }, { 2, 0, 1, 0 }, { 0, 0, 0, 0 }, { 255, 255, 0, 0 },
+        { 7, 3, 0, 0 }, { 64, 1, 64, 1 }, { 9, 9, 9, 9 }, { 0, 128, 0, 128 }
+    };
+    for (int i = 0; i < length; i += 4) {
+        const uint8_t *word = WORDS[next_random() % 8];
+        for (int j = 0; j < 4 && i + j < length; j++) {
+            data[i + j] = word[j];
+        }
+    }
+}
+
+static int check_generated(void)
+{
+    static const int SIZES[] = { 1, 2, 3, 17, 255, 4096, 65536, 312500 };
+    static void (*const FILLS[])(uint8_t *, int) = { fill_random, fill_sparse, fill_repetitive };
+    static const char *FILL_NAMES[] = { "random", "sparse", "repetitive" };
+    int ok = 1;
+    for (int f = 0; f < 3; f++) {
+        for (unsigned int s = 0; s < sizeof(SIZES) / sizeof(int); s++) {
+            int length = SIZES[s];
+            uint8_t *data = (uint8_t *) malloc(length + 1);
+            if (!data) {
+                return 0;
+            }
+            FILLS[f](data, length);
+            char name[64];
+            snprintf(name, sizeof(name), "%s %d", FILL_NAMES[f], length);
+            ok &= check_payload(name, data, length, length >= 65536);
+            free(data);
+        }
+    }
+    return ok;
+}
+
+static int check_file(const char *filename)
+{
+    FILE *fp = fopen(filename, "rb");
+    if (!fp) {
+        fprintf(stderr, "%s: unable to open\n", filename);
+        return 0;
+    }
+    fseek(fp, 0, SEEK_END);
+    long length = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    uint8_t *data = (uint8_t *) malloc(length + 1);
+    int ok = data && fread(data, 1, length, fp) == (size_t) length;
+    fclose(fp);
+    if (ok) {
+        ok = check_payload(filename, data, (int) length, 1);
+    } else {
+        fprintf(stderr, "%s: unable to read\n", filename);
+    }
+    free(data);
+    return ok;
+}
+
+int main(int argc, char **argv)
+{
+    int ok = check_generated();
+    for (int i = 1; i < argc; i++) {
+        ok &= check_file(argv[i]);
+    }
+    printf(ok ? "All round trips succeeded\n" : "Round trip check FAILED\n");
+    return ok ? 0 : 1;
+}